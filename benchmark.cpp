@@ -0,0 +1,633 @@
+/*
+    Program: benchmark.cpp
+    Purpose: Measures the expression engine in truth_table.h: lexing, post-fix
+             conversion, parsing and optimizing, and evaluation through every
+             backend, over a generated corpus of formulas that differ in
+             number of propositions, depth, operator mix and how much they
+             repeat themselves. Every benchmark reports the time per
+             operation, rows per second for the evaluators, and heap
+             allocations per operation.
+
+             With --differential it checks instead of measuring: every
+             backend fills the whole table of random formulas, and each
+             result is compared bit for bit against the original stack
+             based evaluation of the post-fix tokens. Every backend reports
+             its mismatches next to its rows per second, so a semantic and
+             a performance regression show up in the same run.
+
+             Command line options:
+             - --json:              print the results as JSON, one object per
+                                    benchmark, for tracking across releases.
+             - --filter TEXT:       only run benchmarks whose name contains TEXT.
+             - --min-time SECONDS:  run each benchmark at least this long
+                                    (default 0.2).
+             - --seed N:            generate a different corpus.
+             - --differential N:    check every backend against the
+                                    reference over N random formulas, and
+                                    a few fixed ones built at compile time.
+                                    Exits with 1 if any disagrees.
+
+    Build:   g++ -std=c++17 -O2 -pthread benchmark.cpp truth_table.cpp -o benchmark
+    Written in C++17.
+*/
+
+
+#include "truth_table.h"
+#include "static_formula.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <map>
+#include <stack>
+#include <new>
+
+// Every allocation of the process is counted, so a benchmark can tell how
+// many its operation makes. The whole family of replaceable allocation
+// functions is replaced, so every new is paired with its own delete. They
+// are kept out of line: once inlined into a caller, the free() in a delete
+// looks to the compiler like it is freeing memory from the library's
+// operator new.
+static std::atomic<std::uint64_t> allocation_count{0};
+
+#if defined(__GNUC__)
+    #define TTG_NOINLINE __attribute__((noinline))
+#else
+    #define TTG_NOINLINE
+#endif
+
+TTG_NOINLINE static void* countedAllocation(std::size_t size, std::size_t alignment) noexcept {
+    ++allocation_count;
+    if(alignment <= alignof(std::max_align_t)) return std::malloc(size ? size : 1);
+    // aligned_alloc() wants a multiple of the alignment.
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+TTG_NOINLINE static void countedFree(void* p) noexcept {std::free(p);}
+
+TTG_NOINLINE void* operator new(std::size_t size) {
+    if(void* p = countedAllocation(size, 0)) return p;
+    throw std::bad_alloc();
+}
+TTG_NOINLINE void* operator new[](std::size_t size) {return operator new(size);}
+TTG_NOINLINE void* operator new(std::size_t size, const std::nothrow_t&) noexcept {return countedAllocation(size, 0);}
+TTG_NOINLINE void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {return countedAllocation(size, 0);}
+TTG_NOINLINE void* operator new(std::size_t size, std::align_val_t alignment) {
+    if(void* p = countedAllocation(size, static_cast<std::size_t>(alignment))) return p;
+    throw std::bad_alloc();
+}
+TTG_NOINLINE void* operator new[](std::size_t size, std::align_val_t alignment) {return operator new(size, alignment);}
+
+TTG_NOINLINE void operator delete(void* p) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete[](void* p) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete(void* p, std::size_t) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete[](void* p, std::size_t) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete(void* p, const std::nothrow_t&) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete[](void* p, const std::nothrow_t&) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete(void* p, std::align_val_t) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete[](void* p, std::align_val_t) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept {countedFree(p);}
+TTG_NOINLINE void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {countedFree(p);}
+
+// Settings taken from the command line.
+struct Options {
+    bool json = false;
+    std::string filter;
+    double min_time = 0.2;
+    std::uint64_t seed = 1;
+    std::uint64_t differential = 0;  // Formulas to check with --differential.
+};
+
+// What a corpus formula is made of.
+struct Shape {
+    const char* name;
+    int variables;
+    int depth;
+    const char* operators;  // Binary operators to pick from, one character each.
+    double repetition;      // Chance of reusing an already generated subterm.
+};
+
+// Generates random formulas of a given shape. Operators are written out in
+// the Lexer's syntax, '>' standing for "->", '=' for "<->" and 'x' for
+// "<+>".
+class FormulaGenerator {
+    public:
+        explicit FormulaGenerator(std::uint64_t seed) : _random(seed) {}
+
+        std::string generate(const Shape& shape) {
+            _subterms.clear();
+            std::string formula = term(shape, shape.depth);
+            // Every proposition shows up at least once, so the table really
+            // has 2 ^ variables rows.
+            for(int v = 0; v < shape.variables; ++v) formula += " v " + name(v) + " ^ 0";
+            return formula;
+        }
+
+    private:
+        std::string term(const Shape& shape, int depth) {
+            if(!_subterms.empty() && chance(shape.repetition)) return _subterms[pick(_subterms.size())];
+            std::string result;
+            if(depth == 0 || chance(0.1)) {
+                result = name(static_cast<int>(pick(shape.variables)));
+            } else if(chance(0.15)) {
+                result = "~" + term(shape, depth - 1);
+            } else {
+                std::string op;
+                switch(shape.operators[pick(std::string(shape.operators).size())]) {
+                    case '^': op = " ^ "; break;
+                    case 'v': op = " v "; break;
+                    case '>': op = " -> "; break;
+                    case 'x': op = " <+> "; break;
+                    case '|': op = " | "; break;
+                    case '#': op = " # "; break;
+                    default:  op = " <-> "; break;
+                }
+                result = "(" + term(shape, depth - 1) + op + term(shape, depth - 1) + ")";
+            }
+            _subterms.push_back(result);
+            return result;
+        }
+
+        // Proposition names avoid the characters that mean something else.
+        static std::string name(int v) {
+            static const std::string names = "abcdefghijklmnopqrstuwxyzABCDEGHIJKLMNOPQRSUVWXYZ";
+            return std::string(1, names[v]);
+        }
+
+        bool chance(double p) {return std::uniform_real_distribution<double>(0, 1)(_random) < p;}
+        std::size_t pick(std::size_t n) {return std::uniform_int_distribution<std::size_t>(0, n - 1)(_random);}
+
+        std::mt19937_64 _random;
+        std::vector<std::string> _subterms;
+};
+
+// One benchmark's measurements.
+struct Result {
+    std::string name;
+    std::string formula;       // Corpus entry, by shape name.
+    std::uint64_t iterations;  // Times the operation ran.
+    double seconds;            // Total time those took.
+    std::uint64_t rows;        // Rows evaluated per operation, 0 if it does not evaluate.
+    double allocations;        // Heap allocations per operation.
+};
+
+class Runner {
+    public:
+        explicit Runner(const Options& options) : _options(options) {}
+
+        // Runs operation, which evaluates rows rows (or none), until it has
+        // taken at least the minimum time, and records the result.
+        template<class Operation>
+        void run(const std::string& name, const std::string& formula, std::uint64_t rows, Operation operation) {
+            std::string full = name + "/" + formula;
+            if(!_options.filter.empty() && full.find(_options.filter) == std::string::npos) return;
+            operation();  // Warms up caches and lazily built state.
+
+            std::uint64_t iterations = 1;
+            while(true) {
+                std::uint64_t allocations = allocation_count;
+                auto start = std::chrono::steady_clock::now();
+                for(std::uint64_t i = 0; i < iterations; ++i) operation();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                allocations = allocation_count - allocations;
+                if(seconds >= _options.min_time || iterations >= (std::uint64_t{1} << 40)) {
+                    _results.push_back({name, formula, iterations, seconds, rows,
+                                        static_cast<double>(allocations) / iterations});
+                    print(_results.back());
+                    return;
+                }
+                // Aim a little past the minimum time with the next attempt.
+                double scale = seconds > 0 ? 1.4 * _options.min_time / seconds : 100;
+                iterations = static_cast<std::uint64_t>(iterations * std::min(100.0, std::max(2.0, scale)));
+            }
+        }
+
+        void finish() {
+            if(_options.json) std::cout << (_results.empty() ? "[" : "\n") << "]\n";
+        }
+
+    private:
+        void print(const Result& r) {
+            double ns = 1e9 * r.seconds / r.iterations;
+            if(_options.json) {
+                std::cout << (_results.size() == 1 ? "[\n" : ",\n")
+                          << "  {\"name\": \"" << r.name << "\", \"formula\": \"" << r.formula
+                          << "\", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << ns;
+                if(r.rows) {
+                    std::cout << ", \"rows\": " << r.rows << ", \"ns_per_row\": " << ns / r.rows
+                              << ", \"rows_per_second\": " << 1e9 * r.rows / ns;
+                }
+                std::cout << ", \"allocations_per_op\": " << r.allocations << "}";
+                return;
+            }
+            std::cout << r.name << "/" << r.formula << ":\t" << ns << " ns/op";
+            if(r.rows) std::cout << "\t" << ns / r.rows << " ns/row\t" << 1e9 * r.rows / ns << " rows/s";
+            std::cout << "\t" << r.allocations << " allocs/op\n";
+        }
+
+        const Options& _options;
+        std::vector<Result> _results;
+};
+
+// The optimizer must not throw away a result nobody reads.
+static volatile std::uint64_t sink;
+
+void benchmarkFormula(Runner& runner, const Shape& shape, const std::string& formula) {
+    std::string name = shape.name;
+
+    // Front end.
+    Lexer lexer;
+    runner.run("lex", name, 0, [&]{lexer.scan(formula);});
+    lexer.scan(formula);
+    const std::vector<Token>& tokens = lexer.getTokens();
+    runner.run("to_postfix", name, 0, [&]{sink = toPostFix(tokens).size();});
+    Parser parser;
+    runner.run("parse", name, 0, [&]{sink = parser.parse(tokens);});
+    parser.parse(tokens);
+    const Expression& parsed = parser.expression();
+    runner.run("optimize", name, 0, [&]{sink = optimize(parsed).nodes().size();});
+    Expression optimized = optimize(parsed);
+    const std::vector<std::string_view>& propositions = lexer.getPropositions();
+    runner.run("compile", name, 0, [&]{sink = CompiledFormula(optimized, propositions).instructionCount();});
+
+    // Evaluators, each over the whole table.
+    CompiledFormula compiled(optimized, propositions);
+    std::uint64_t rows = compiled.rowCount();
+    std::vector<std::uint64_t> bits((rows + 63) / 64);
+    runner.run("eval_row", name, rows, [&]{
+        std::uint64_t count = 0;
+        for(std::uint64_t row = 0; row < rows; ++row) count += compiled.eval(row);
+        sink = count;
+    });
+    static const char* kernel_names[] = {"scalar", "avx2", "avx512"};
+    for(int k = CompiledFormula::SCALAR; k <= CompiledFormula::bestKernel(); ++k) {
+        CompiledFormula kernel = compiled;
+        kernel.setKernel(static_cast<CompiledFormula::Kernel>(k));
+        runner.run(std::string("eval_block_") + kernel_names[k], name, rows, [&]{kernel.evalBlock(0, rows, bits.data());});
+    }
+    CompiledFormula native = compiled;
+    if(native.enableNative()) {
+        runner.run("eval_block_native", name, rows, [&]{native.evalBlock(0, rows, bits.data());});
+    }
+    runner.run("count", name, rows, [&]{sink = compiled.countSatisfying();});
+    IncrementalFormula gray(optimized);
+    runner.run("gray", name, rows, [&]{
+        std::uint64_t count = gray.reset(0);
+        for(std::uint64_t i = 1; i < rows; ++i) count += gray.flip(IncrementalFormula::grayBit(i));
+        sink = count;
+    });
+    SplitFormula split(optimized, propositions, 8);
+    runner.run("split_count", name, rows, [&]{sink = split.countSatisfying(0, rows);});
+    runner.run("bdd_count", name, rows, [&]{
+        BDD bdd(compiled.variableCount());
+        sink = bdd.countModels(bdd.build(parsed)).toString().size();
+    });
+    if(compiled.variableCount() <= MAX_MINIMIZE_VARIABLES) {
+        compiled.evalBlock(0, rows, bits.data());
+        runner.run("minimize_dnf", name, rows, [&]{sink = minimizeCover(bits, compiled.variableCount(), true).size();});
+    }
+}
+
+// The whole table of a formula as the original program worked it out: the
+// post-fix tokens run on an operand stack once per row, with propositions
+// looked up by name. Slow, and simple enough to be the reference.
+std::vector<std::uint64_t> referenceTable(const std::vector<Token>& postfix, const std::vector<std::string_view>& propositions) {
+    std::map<std::string_view, int> slots;
+    for(std::size_t s = 0; s < propositions.size(); ++s) slots[propositions[s]] = static_cast<int>(s);
+    int variables = static_cast<int>(propositions.size());
+    std::uint64_t rows = std::uint64_t{1} << variables;
+    std::vector<std::uint64_t> bits((rows + 63) / 64);
+    std::stack<bool> operands;
+    for(std::uint64_t row = 0; row < rows; ++row) {
+        auto pop = [&operands]() {
+            bool top = operands.top();
+            operands.pop();
+            return top;
+        };
+        for(const Token& t : postfix) {
+            if(t.type() == Token::TRUTH_VALUE) {
+                operands.push(t.value());
+            } else if(t.type() == Token::PROPOSITION) {
+                operands.push(!((row >> (variables - 1 - slots[t.lexeme()])) & 1));
+            } else if(t.type() == Token::NEGATION) {
+                operands.push(!pop());
+            } else {
+                bool right = pop();
+                bool left = pop();
+                switch(t.type()) {
+                    case Token::CONJUNCTION:           operands.push(left && right); break;
+                    case Token::DISJUNCTION:           operands.push(left || right); break;
+                    case Token::IMPLICATION:           operands.push(left <= right); break;
+                    case Token::BICONDITIONAL:         operands.push(left == right); break;
+                    case Token::EXCLUSIVE_DISJUNCTION: operands.push(left != right); break;
+                    case Token::ALTERNATIVE_DENIAL:    operands.push(!(left && right)); break;
+                    default:                           operands.push(!(left || right)); break;
+                }
+            }
+        }
+        if(pop()) bits[row / 64] |= std::uint64_t{1} << (row % 64);
+    }
+    return bits;
+}
+
+// Runs every backend over formulas and compares what they produce with
+// referenceTable(), keeping count per backend.
+class DifferentialRunner {
+    public:
+        explicit DifferentialRunner(const Options& options) : _options(options), _random(options.seed) {}
+
+        void check(const std::string& formula) {
+            Lexer lexer(formula);
+            const std::vector<Token>& tokens = lexer.getTokens();
+            Parser parser;
+            if(!parser.parse(tokens)) {
+                std::cerr << "Generated formula does not parse: " << formula << '\n';
+                ++_failures;
+                return;
+            }
+            const std::vector<std::string_view>& propositions = lexer.getPropositions();
+            const Expression& parsed = parser.expression();
+            Expression optimized = optimize(parsed);
+            int variables = static_cast<int>(propositions.size());
+            std::uint64_t rows = std::uint64_t{1} << variables;
+            std::vector<std::uint64_t> reference = referenceTable(toPostFix(tokens), propositions);
+            std::uint64_t count = 0;
+            for(std::uint64_t w : reference) count += CompiledFormula::popCount(w);
+
+            CompiledFormula compiled(optimized, propositions);
+            compare("eval_row", formula, reference, rows, [&](std::uint64_t* bits) {
+                for(std::uint64_t row = 0; row < rows; ++row) {
+                    if(compiled.eval(row)) bits[row / 64] |= std::uint64_t{1} << (row % 64);
+                }
+            });
+            static const char* kernel_names[] = {"eval_block_scalar", "eval_block_avx2", "eval_block_avx512"};
+            for(int k = CompiledFormula::SCALAR; k <= CompiledFormula::bestKernel(); ++k) {
+                CompiledFormula kernel = compiled;
+                kernel.setKernel(static_cast<CompiledFormula::Kernel>(k));
+                compare(kernel_names[k], formula, reference, rows, [&](std::uint64_t* bits) {kernel.evalBlock(0, rows, bits);});
+            }
+            CompiledFormula native = compiled;
+            if(native.enableNative()) {
+                compare("eval_block_native", formula, reference, rows, [&](std::uint64_t* bits) {native.evalBlock(0, rows, bits);});
+            }
+            CompiledFormula unoptimized(parsed, propositions);
+            compare("unoptimized", formula, reference, rows, [&](std::uint64_t* bits) {unoptimized.evalBlock(0, rows, bits);});
+
+            // The queries that stop early or only count, against the same table.
+            std::uint64_t first_true = rows, first_false = rows;
+            for(std::uint64_t row = rows; row-- > 0;) {
+                if((reference[row / 64] >> (row % 64)) & 1) first_true = row;
+                else first_false = row;
+            }
+            std::uint64_t found[3];
+            compareValues("queries", formula, rows, {count, first_true, first_false}, [&]() {
+                found[0] = compiled.countSatisfying();
+                found[1] = compiled.firstSatisfying(0, rows);
+                found[2] = compiled.firstFalsifying(0, rows);
+                return std::vector<std::uint64_t>(found, found + 3);
+            });
+
+            int k = static_cast<int>(std::uniform_int_distribution<int>(1, 4)(_random));
+            SplitFormula split(optimized, propositions, k);
+            compare("split", formula, reference, rows, [&](std::uint64_t* bits) {split.evalBlock(0, rows, bits);});
+            compareValues("split_queries", formula, rows, {count, first_true, first_false}, [&]() {
+                return std::vector<std::uint64_t>{split.countSatisfying(0, rows), split.firstSatisfying(0, rows), split.firstFalsifying(0, rows)};
+            });
+
+            IncrementalFormula gray(optimized);
+            compare("gray", formula, reference, rows, [&](std::uint64_t* bits) {
+                for(std::uint64_t i = 0; i < rows; ++i) {
+                    bool value = i == 0 ? gray.reset(0) : gray.flip(IncrementalFormula::grayBit(i));
+                    std::uint64_t row = IncrementalFormula::grayRow(i);
+                    if(value) bits[row / 64] |= std::uint64_t{1} << (row % 64);
+                }
+            });
+
+            ColumnFormula columns(parsed, {parsed.root()});
+            compare("columns", formula, reference, rows, [&](std::uint64_t* bits) {
+                for(std::uint64_t first = 0; first < rows; first += 64) columns.evalBlock(first, bits + first / 64);
+            });
+
+            // The diagram has no rows to compare, so it has to count the same
+            // and, where the table is small enough to write out as one term per
+            // true row, be the same diagram as that.
+            std::vector<std::uint64_t> expected_bdd{1};
+            compareValues("bdd", formula, rows, expected_bdd, [&]() {
+                BDD bdd(variables);
+                BDD::Ref root = bdd.build(parsed);
+                bool same = bdd.countModels(root).toString() == std::to_string(count);
+                if(same && variables <= 10) {
+                    std::vector<Cube> minterms;
+                    for(std::uint64_t row = 0; row < rows; ++row) {
+                        if((reference[row / 64] >> (row % 64)) & 1) minterms.push_back({rows - 1, row});
+                    }
+                    same = bdd.equivalent(root, bdd.build(sumOfProducts(minterms, variables)));
+                }
+                return std::vector<std::uint64_t>{same};
+            });
+
+            if(variables <= MAX_MINIMIZE_VARIABLES) {
+                for(bool sum : {true, false}) {
+                    std::vector<Cube> cover = minimizeCover(reference, variables, sum);
+                    CompiledFormula minimized(sum ? sumOfProducts(cover, variables) : productOfSums(cover, variables), propositions);
+                    compare(sum ? "minimized_dnf" : "minimized_cnf", formula, reference, rows,
+                            [&](std::uint64_t* bits) {minimized.evalBlock(0, rows, bits);});
+                }
+            }
+            CompiledFormula cheapest(cheapestForm(optimized, propositions), propositions);
+            compare("cheapest_form", formula, reference, rows, [&](std::uint64_t* bits) {cheapest.evalBlock(0, rows, bits);});
+        }
+
+        // Formulas built at compile time, see checkStaticFormulas().
+        template<class Fill>
+        void checkStatic(const std::string& formula, Fill fill) {
+            Lexer lexer(formula);
+            std::vector<std::uint64_t> reference = referenceTable(toPostFix(lexer.getTokens()), lexer.getPropositions());
+            compare("static", formula, reference, std::uint64_t{1} << lexer.getPropositions().size(), fill);
+        }
+
+        // Prints a line per backend, returns false if any of them disagreed.
+        bool finish() {
+            std::uint64_t mismatches = _failures;
+            if(_options.json) std::cout << "[";
+            for(std::size_t b = 0; b < _backends.size(); ++b) {
+                const Backend& r = _backends[b];
+                double rate = r.seconds > 0 ? r.rows / r.seconds : 0;
+                if(_options.json) {
+                    std::cout << (b ? ",\n  " : "\n  ") << "{\"name\": \"" << r.name << "\", \"formulas\": " << r.formulas
+                              << ", \"rows\": " << r.rows << ", \"mismatches\": " << r.mismatches
+                              << ", \"rows_per_second\": " << rate << "}";
+                } else {
+                    std::cout << r.name << ":\t" << r.formulas << " formulas\t" << r.rows << " rows\t"
+                              << r.mismatches << " mismatches\t" << rate << " rows/s\n";
+                }
+                mismatches += r.mismatches;
+            }
+            if(_options.json) std::cout << "\n]\n";
+            return mismatches == 0;
+        }
+
+    private:
+        struct Backend {
+            std::string name;
+            std::uint64_t formulas;
+            std::uint64_t rows;
+            std::uint64_t mismatches;
+            double seconds;
+        };
+
+        Backend& backend(const std::string& name) {
+            for(Backend& b : _backends) {
+                if(b.name == name) return b;
+            }
+            _backends.push_back({name, 0, 0, 0, 0.0});
+            return _backends.back();
+        }
+
+        bool selected(const std::string& name) const {
+            return _options.filter.empty() || name.find(_options.filter) != std::string::npos;
+        }
+
+        // Has fill(bits) produce the table and compares it with reference,
+        // reporting the first row that differs.
+        template<class Fill>
+        void compare(const std::string& name, const std::string& formula, const std::vector<std::uint64_t>& reference,
+                     std::uint64_t rows, Fill fill) {
+            if(!selected(name)) return;
+            std::vector<std::uint64_t> bits(reference.size(), 0);
+            auto start = std::chrono::steady_clock::now();
+            fill(bits.data());
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            bits.back() &= CompiledFormula::blockMask(rows - 64 * (bits.size() - 1));
+            Backend& b = backend(name);
+            ++b.formulas;
+            b.rows += rows;
+            b.seconds += seconds;
+            for(std::size_t w = 0; w < bits.size(); ++w) {
+                if(bits[w] == reference[w]) continue;
+                std::uint64_t row = 64 * w + CompiledFormula::countTrailingZeros(bits[w] ^ reference[w]);
+                if(++b.mismatches <= 5) {
+                    std::cerr << name << " disagrees at row " << row << " (expected " << ((reference[w] >> (row % 64)) & 1)
+                              << "): " << formula << '\n';
+                }
+                break;
+            }
+        }
+
+        // Same for backends that answer with numbers rather than a table.
+        template<class Answer>
+        void compareValues(const std::string& name, const std::string& formula, std::uint64_t rows,
+                           const std::vector<std::uint64_t>& expected, Answer answer) {
+            if(!selected(name)) return;
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::uint64_t> found = answer();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            Backend& b = backend(name);
+            ++b.formulas;
+            b.rows += rows;
+            b.seconds += seconds;
+            if(found != expected && ++b.mismatches <= 5) {
+                std::cerr << name << " disagrees:";
+                for(std::size_t i = 0; i < expected.size(); ++i) std::cerr << ' ' << found[i] << (found[i] == expected[i] ? "" : "(expected " + std::to_string(expected[i]) + ")");
+                std::cerr << ": " << formula << '\n';
+            }
+        }
+
+        const Options& _options;
+        std::mt19937_64 _random;
+        std::vector<Backend> _backends;
+        std::uint64_t _failures = 0;
+};
+
+// StaticFormula needs its formulas at compile time, so it gets a fixed set
+// covering every operator instead of the random ones.
+static constexpr char static_source_1[] = "p ^ q v ~r -> s";
+static constexpr char static_source_2[] = "(a <-> b) <+> (c | d) # ~(e ^ F)";
+static constexpr char static_source_3[] = "~(p v q) <-> (~p ^ ~q) ^ (r -> (s <+> t)) v u | 1";
+static constexpr char static_source_4[] = "((a # b) | (c <+> d)) -> (e <-> f) ^ g v h ^ ~i";
+static constexpr auto static_formula_1 = parseStatic(static_source_1);
+static constexpr auto static_formula_2 = parseStatic(static_source_2);
+static constexpr auto static_formula_3 = parseStatic(static_source_3);
+static constexpr auto static_formula_4 = parseStatic(static_source_4);
+
+template<const auto& E>
+void checkStaticFormula(DifferentialRunner& runner, const char* source) {
+    runner.checkStatic(source, [](std::uint64_t* bits) {
+        for(std::uint64_t first = 0; first < StaticFormula<E>::rowCount(); first += 64) bits[first / 64] = StaticFormula<E>::evalBlock(first);
+    });
+    runner.checkStatic(source, [](std::uint64_t* bits) {
+        for(std::uint64_t row = 0; row < StaticFormula<E>::rowCount(); ++row) {
+            if(StaticFormula<E>::eval(row)) bits[row / 64] |= std::uint64_t{1} << (row % 64);
+        }
+    });
+}
+
+// Checks options.differential random formulas of random shapes, up to 16
+// propositions so the reference stays quick.
+bool runDifferential(const Options& options) {
+    DifferentialRunner runner(options);
+    FormulaGenerator generator(options.seed);
+    std::mt19937_64 random(options.seed + 1);
+    static const char all_operators[] = "^v>=x|#";
+    for(std::uint64_t i = 0; i < options.differential; ++i) {
+        std::string operators;
+        while(operators.empty()) {
+            for(const char* op = all_operators; *op; ++op) {
+                if(random() % 2) operators += *op;
+            }
+        }
+        static const double repetitions[] = {0.0, 0.3, 0.6};
+        Shape shape{"random", static_cast<int>(1 + random() % 16), static_cast<int>(1 + random() % 8),
+                    operators.c_str(), repetitions[random() % 3]};
+        runner.check(generator.generate(shape));
+    }
+    checkStaticFormula<static_formula_1>(runner, static_source_1);
+    checkStaticFormula<static_formula_2>(runner, static_source_2);
+    checkStaticFormula<static_formula_3>(runner, static_source_3);
+    checkStaticFormula<static_formula_4>(runner, static_source_4);
+    return runner.finish();
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--json") {
+            options.json = true;
+        } else if(arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if(arg == "--min-time" && i + 1 < argc) {
+            options.min_time = std::atof(argv[++i]);
+        } else if(arg == "--seed" && i + 1 < argc) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if(arg == "--differential" && i + 1 < argc) {
+            options.differential = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--json] [--filter TEXT] [--min-time SECONDS] [--seed N] [--differential N]\n";
+            return 1;
+        }
+    }
+
+    static const Shape shapes[] = {
+        {"small_mixed",      6,  4, "^v>=", 0.0},
+        {"medium_and_or",   12,  6, "^v",   0.0},
+        {"medium_iff",      12,  6, "=>",   0.0},
+        {"medium_repeated", 12,  8, "^v>=", 0.5},
+        {"medium_extended", 12,  6, "^vx|#", 0.0},
+        {"wide_shallow",    20,  3, "^v>=", 0.0},
+        {"wide_deep",       20, 10, "^v>=", 0.3},
+    };
+    if(options.differential > 0) return runDifferential(options) ? 0 : 1;
+    FormulaGenerator generator(options.seed);
+    Runner runner(options);
+    for(const Shape& shape : shapes) {
+        benchmarkFormula(runner, shape, generator.generate(shape));
+    }
+    runner.finish();
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*
+    Program: shard_merge.cpp
+    Purpose: Puts together the slices of one table written by
+             truth_table_generator --shard K/N --binary FILE, e.g. by N
+             processes on different machines. The slices may be given in any
+             order, but together they have to cover every row of the table
+             exactly once, all for the same expression.
+
+             Command line options, exactly one of:
+             - --count:             print how many rows are true and how many
+                                    rows there are, tab separated.
+             - --first:             print the first row that is true, as
+                                    --batch --first would: a header line
+                                    naming the propositions and the
+                                    expression, then the row. Prints nothing
+                                    else if no row is true.
+             - --output FILE:       write the whole table to FILE in the
+                                    packed binary format of --binary.
+             followed by the slice files.
+
+    Build:   g++ -std=c++17 -O2 shard_merge.cpp -o shard_merge
+    Written in C++17.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// The header of a file written by writeBinaryTable() in
+// truth_table_generator.cpp, see there for the layout.
+struct Slice {
+    std::string path;
+    std::uint32_t version;
+    std::uint64_t rows;     // Of the whole table.
+    std::uint64_t offset;   // Of the bitset.
+    std::uint64_t first;    // First row held.
+    std::uint64_t held;     // Rows held.
+    std::vector<std::string> names;
+    std::string expression;
+};
+
+// Little endian integer of bytes bytes at data.
+std::uint64_t get(const char* data, int bytes) {
+    std::uint64_t value = 0;
+    for(int b = bytes - 1; b >= 0; --b) value = value << 8 | static_cast<unsigned char>(data[b]);
+    return value;
+}
+
+// Reads the header of the file at path into slice. Returns an empty string
+// on success, otherwise what went wrong.
+std::string readSlice(const std::string& path, Slice& slice) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) return "Cannot open " + path + "!";
+    char fixed[48];
+    if(!file.read(fixed, 32) || std::string(fixed, 4) != "TTGB") return path + " is not a table file!";
+    slice.path = path;
+    slice.version = static_cast<std::uint32_t>(get(fixed + 4, 4));
+    if(slice.version != 1 && slice.version != 2) return path + " has an unknown format version!";
+    std::uint64_t variables = get(fixed + 8, 4);
+    std::uint64_t length = get(fixed + 12, 4);
+    slice.rows = get(fixed + 16, 8);
+    slice.offset = get(fixed + 24, 8);
+    slice.first = 0;
+    slice.held = slice.rows;
+    if(slice.version == 2) {
+        if(!file.read(fixed + 32, 16)) return path + " is cut short!";
+        slice.first = get(fixed + 32, 8);
+        slice.held = get(fixed + 40, 8);
+    }
+    slice.names.clear();
+    for(std::uint64_t v = 0; v < variables; ++v) {
+        char size[2];
+        if(!file.read(size, 2)) return path + " is cut short!";
+        std::string name(get(size, 2), ' ');
+        if(!file.read(&name[0], name.size())) return path + " is cut short!";
+        slice.names.push_back(name);
+    }
+    slice.expression.assign(length, ' ');
+    if(!file.read(&slice.expression[0], length)) return path + " is cut short!";
+    if(slice.first % 64 != 0 || slice.first > slice.rows || slice.held > slice.rows - slice.first) {
+        return path + " holds rows outside its table!";
+    }
+    return "";
+}
+
+// Calls visit(row, word) for every word of the slice's bitset in order,
+// where word holds the rows starting at row, with the bits past the slice
+// cleared. Returns false if the file is cut short.
+template<class Visit>
+bool forEachWord(const Slice& slice, Visit visit) {
+    std::ifstream file(slice.path, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(slice.offset));
+    std::uint64_t words = (slice.held + 63) / 64;
+    std::vector<char> buffer(8 << 16);
+    for(std::uint64_t done = 0; done < words;) {
+        std::uint64_t count = std::min<std::uint64_t>(words - done, buffer.size() / 8);
+        if(!file.read(buffer.data(), static_cast<std::streamsize>(8 * count))) return false;
+        for(std::uint64_t w = 0; w < count; ++w, ++done) {
+            std::uint64_t word = get(buffer.data() + 8 * w, 8);
+            std::uint64_t remaining = slice.held - 64 * done;
+            if(remaining < 64) word &= (std::uint64_t{1} << remaining) - 1;
+            if(!visit(slice.first + 64 * done, word)) return true;
+        }
+    }
+    return true;
+}
+
+// Writes the whole table to path as a version 1 file. Slices start on word
+// boundaries, so their bitsets are just written one after the other.
+std::string writeTable(const std::vector<Slice>& slices, const std::string& path) {
+    const Slice& any = slices.front();
+    std::string header = "TTGB";
+    auto put = [&header](std::uint64_t value, int bytes) {
+        for(int b = 0; b < bytes; ++b) header += static_cast<char>((value >> (8 * b)) & 0xFF);
+    };
+    put(1, 4);
+    put(any.names.size(), 4);
+    put(any.expression.size(), 4);
+    put(any.rows, 8);
+    put(0, 8); // Offset, filled in below.
+    for(const std::string& name : any.names) {
+        put(name.size(), 2);
+        header += name;
+    }
+    header += any.expression;
+    std::uint64_t offset = (header.size() + 63) / 64 * 64;
+    for(int b = 0; b < 8; ++b) header[24 + b] = static_cast<char>((offset >> (8 * b)) & 0xFF);
+    header.resize(offset, '\0');
+
+    std::ofstream file(path, std::ios::binary);
+    if(!file || !file.write(header.data(), header.size())) return "Cannot write " + path + "!";
+    std::string words;
+    for(const Slice& slice : slices) {
+        bool complete = forEachWord(slice, [&](std::uint64_t, std::uint64_t word) {
+            for(int b = 0; b < 8; ++b) words += static_cast<char>((word >> (8 * b)) & 0xFF);
+            if(words.size() >= (1 << 20)) {
+                file.write(words.data(), words.size());
+                words.clear();
+            }
+            return true;
+        });
+        if(!complete) return slice.path + " is cut short!";
+    }
+    if(!file.write(words.data(), words.size())) return "Cannot write " + path + "!";
+    return "";
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " (--count | --first | --output FILE) SLICE...\n"
+              << "  --count             print how many rows are true, and how many there are.\n"
+              << "  --first             print the first row that is true.\n"
+              << "  --output FILE       write the whole table to FILE as a packed bitset.\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode;
+    std::string output;
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--count" || arg == "--first") {
+            mode = arg;
+        } else if(arg == "--output" && i + 1 < argc) {
+            mode = arg;
+            output = argv[++i];
+        } else if(arg.compare(0, 2, "--") == 0) {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if(mode.empty() || paths.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Slice> slices(paths.size());
+    for(std::size_t i = 0; i < paths.size(); ++i) {
+        std::string error = readSlice(paths[i], slices[i]);
+        if(!error.empty()) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        if(slices[i].names != slices[0].names || slices[i].expression != slices[0].expression || slices[i].rows != slices[0].rows) {
+            std::cerr << paths[i] << " is a slice of another table than " << paths[0] << "!\n";
+            return 1;
+        }
+    }
+
+    // Every row has to be in exactly one slice.
+    std::sort(slices.begin(), slices.end(), [](const Slice& a, const Slice& b) {return a.first < b.first;});
+    std::uint64_t covered = 0;
+    for(const Slice& slice : slices) {
+        if(slice.held == 0) continue;
+        if(slice.first != covered) {
+            std::cerr << (slice.first < covered ? "Slices overlap at row " : "No slice holds row ")
+                      << std::min(slice.first, covered) << "!\n";
+            return 1;
+        }
+        covered += slice.held;
+    }
+    if(covered != slices[0].rows) {
+        std::cerr << "No slice holds row " << covered << "!\n";
+        return 1;
+    }
+
+    if(mode == "--output") {
+        std::string error = writeTable(slices, output);
+        if(!error.empty()) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    std::uint64_t count = 0;
+    std::uint64_t first = slices[0].rows;  // Lowest true row, rows if none.
+    for(const Slice& slice : slices) {
+        bool complete = forEachWord(slice, [&](std::uint64_t row, std::uint64_t word) {
+            if(mode == "--count") {
+                for(; word; word &= word - 1) ++count;
+                return true;
+            }
+            if(!word) return true;
+            int bit = 0;
+            while(!((word >> bit) & 1)) ++bit;
+            first = row + bit;
+            return false;
+        });
+        if(!complete) {
+            std::cerr << slice.path << " is cut short!\n";
+            return 1;
+        }
+        if(first != slices[0].rows) break;
+    }
+
+    if(mode == "--count") {
+        std::cout << count << '\t' << slices[0].rows << '\n';
+        return 0;
+    }
+    if(first == slices[0].rows) return 0;
+    // Same as the text table: the first proposition is the most significant
+    // row bit, and a 0 bit means True.
+    const std::vector<std::string>& names = slices[0].names;
+    for(const std::string& name : names) std::cout << name << '\t';
+    std::cout << slices[0].expression << '\n';
+    for(std::size_t j = 0; j < names.size(); ++j) {
+        std::cout << ("TF"[(first >> (names.size() - 1 - j)) & 1]) << '\t';
+    }
+    std::cout << "T\n";
+    return 0;
+}
@@ -0,0 +1,307 @@
+/*
+    Program: static_formula.h
+    Purpose: Compile time version of the expression pipeline in truth_table.h,
+             for formulas that are known when the program is built. A formula
+             string literal is lexed and parsed by constexpr code following
+             the same rules as Lexer and Parser, the same operators, truth
+             values and precedence levels L1 to L5, and StaticFormula turns
+             the result into an evaluator whose every operation is resolved
+             at compile time, so nothing is parsed or dispatched at run time:
+
+                 static constexpr auto majority = parseStatic("p^q v p^r v q^r");
+                 bool result = StaticFormula<majority>::eval(row);
+
+             Rows and slots are numbered as in CompiledFormula.
+    Written in C++17.
+*/
+
+#ifndef STATIC_FORMULA_H
+#define STATIC_FORMULA_H
+
+#include "truth_table.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+
+// A formula parsed at compile time, laid out like Expression: nodes only
+// refer to nodes before them and the last node is the root. N is the size of
+// the source literal, which bounds the number of tokens and nodes.
+template<std::size_t N>
+struct StaticExpression {
+    Expression::Kind kinds[N]{};
+    std::uint32_t lefts[N]{};    // Operand of NOT, left operand, or slot of a VARIABLE.
+    std::uint32_t rights[N]{};   // Right operand of a binary operation.
+    std::size_t node_count{};
+    char names[N]{};             // Proposition names in slot order.
+    int variable_count{};
+    bool valid{false};
+    const char* error_message = "";
+    std::size_t error_column{};  // Counting from 1, as in Parser.
+
+    std::string_view name(int slot) const {return std::string_view(names + slot, 1);}
+
+    // The same expression as built by Parser, to hand to the run time engine.
+    Expression expression() const {
+        Expression result;
+        result.clear(variable_count);
+        for(std::size_t i = 0; i < node_count; ++i) result.add(kinds[i], lefts[i], rights[i]);
+        return result;
+    }
+};
+
+// The constexpr counterpart of Lexer followed by Parser.
+template<std::size_t N>
+class StaticParser {
+    public:
+        constexpr StaticExpression<N> parse(const char (&source)[N]) {
+            lex(source);
+            build();
+            return _result;
+        }
+
+    private:
+        struct StaticToken {
+            Token::Type type;
+            Token::Precedence precedence;
+            bool value;
+            unsigned char character;
+            std::size_t position;
+        };
+
+        // Same as Lexer::scan(), including what it skips: a '-' or '<' that
+        // does not start an operator is dropped along with the character
+        // after it.
+        constexpr void lex(const char (&source)[N]) {
+            std::size_t length = N - 1;   // Without the terminating '\0'.
+            bool seen[256]{};
+            std::size_t position = 0;
+            while(position < length) {
+                std::size_t start = position;
+                unsigned char c = static_cast<unsigned char>(source[position]);
+                switch(c) {
+                    case ' ':
+                        break;
+                    case '0': case 'F':
+                        add(Token::TRUTH_VALUE, Token::NA, false, c, start);
+                        break;
+                    case '1': case 'T':
+                        add(Token::TRUTH_VALUE, Token::NA, true, c, start);
+                        break;
+                    case '(':
+                        add(Token::LPAREN, Token::NA, false, c, start);
+                        break;
+                    case ')':
+                        add(Token::RPAREN, Token::NA, false, c, start);
+                        break;
+                    case '^': case '*':
+                        add(Token::CONJUNCTION, Token::L2, false, c, start);
+                        break;
+                    case 'v': case '+':
+                        add(Token::DISJUNCTION, Token::L3, false, c, start);
+                        break;
+                    case '|':
+                        add(Token::ALTERNATIVE_DENIAL, Token::L2, false, c, start);
+                        break;
+                    case '#':
+                        add(Token::JOINT_DENIAL, Token::L3, false, c, start);
+                        break;
+                    case '!': case '~':
+                        add(Token::NEGATION, Token::L1, false, c, start);
+                        break;
+                    case '-':
+                        if(++position < length && source[position] == '>') add(Token::IMPLICATION, Token::L4, false, c, start);
+                        break;
+                    case '<':
+                        if(++position < length && (source[position] == '-' || source[position] == '+')) {
+                            bool iff = source[position] == '-';
+                            if(++position < length && source[position] == '>') {
+                                add(iff ? Token::BICONDITIONAL : Token::EXCLUSIVE_DISJUNCTION, Token::L5, false, c, start);
+                            }
+                        }
+                        break;
+                    default:
+                        add(Token::PROPOSITION, Token::NA, false, c, start);
+                        seen[c] = true;
+                        break;
+                }
+                ++position;
+            }
+            // Slots in sorted order, as the Lexer numbers them.
+            for(int c = 0; c < 256; ++c) {
+                if(!seen[c]) continue;
+                _slots[c] = static_cast<std::uint32_t>(_result.variable_count);
+                _result.names[_result.variable_count++] = static_cast<char>(c);
+            }
+        }
+
+        constexpr void add(Token::Type type, Token::Precedence precedence, bool value, unsigned char c, std::size_t position) {
+            _tokens[_token_count++] = StaticToken{type, precedence, value, c, position};
+        }
+
+        constexpr std::uint32_t node(Expression::Kind kind, std::uint32_t left = 0, std::uint32_t right = 0) {
+            _result.kinds[_result.node_count] = kind;
+            _result.lefts[_result.node_count] = left;
+            _result.rights[_result.node_count] = right;
+            return static_cast<std::uint32_t>(_result.node_count++);
+        }
+
+        constexpr void fail(const char* message, std::size_t column) {
+            _result.valid = false;
+            _result.error_message = message;
+            _result.error_column = column;
+        }
+
+        // Same as Parser::parse().
+        constexpr void build() {
+            bool expect_operand = true;
+            for(std::size_t i = 0; i < _token_count; ++i) {
+                const StaticToken& t = _tokens[i];
+                std::size_t column = t.position + 1;
+                bool is_operator = t.type >= Token::NEGATION && t.type <= Token::JOINT_DENIAL;
+                if(expect_operand) {
+                    if(t.type == Token::TRUTH_VALUE) {
+                        _operands[_operand_count++] = node(t.value ? Expression::TRUE_CONSTANT : Expression::FALSE_CONSTANT);
+                        expect_operand = false;
+                    } else if(t.type == Token::PROPOSITION) {
+                        _operands[_operand_count++] = node(Expression::VARIABLE, _slots[t.character]);
+                        expect_operand = false;
+                    } else if(t.type == Token::NEGATION || t.type == Token::LPAREN) {
+                        _operators[_operator_count++] = i;
+                    } else {
+                        return fail("Expected a proposition, a truth value, a negation or '('", column);
+                    }
+                } else if(is_operator && t.type != Token::NEGATION) {
+                    reduce(t.precedence);
+                    _operators[_operator_count++] = i;
+                    expect_operand = true;
+                } else if(t.type == Token::RPAREN) {
+                    reduce(Token::NA);
+                    if(_operator_count == 0) return fail("Unmatched ')'", column);
+                    --_operator_count;
+                } else {
+                    return fail("Expected an operator or ')'", column);
+                }
+            }
+            if(_token_count == 0) return fail("Empty expression", 1);
+            if(expect_operand) {
+                const StaticToken& last = _tokens[_token_count - 1];
+                std::size_t size = last.type == Token::IMPLICATION ? 2 :
+                                   last.type == Token::BICONDITIONAL || last.type == Token::EXCLUSIVE_DISJUNCTION ? 3 : 1;
+                return fail("Expression ends unexpectedly", last.position + size + 1);
+            }
+            reduce(Token::NA);
+            if(_operator_count != 0) return fail("Unmatched '('", _tokens[_operators[_operator_count - 1]].position + 1);
+            _result.valid = true;
+        }
+
+        // Same as Parser::reduce().
+        constexpr void reduce(int precedence) {
+            while(_operator_count != 0) {
+                const StaticToken& top = _tokens[_operators[_operator_count - 1]];
+                if(top.type == Token::LPAREN || precedence <= top.precedence) break;
+                --_operator_count;
+                std::uint32_t right = _operands[--_operand_count];
+                if(top.type == Token::NEGATION) {
+                    _operands[_operand_count++] = node(Expression::NOT, right);
+                    continue;
+                }
+                Expression::Kind kind = top.type == Token::CONJUNCTION           ? Expression::AND     :
+                                        top.type == Token::DISJUNCTION           ? Expression::OR      :
+                                        top.type == Token::IMPLICATION           ? Expression::IMPLIES :
+                                        top.type == Token::BICONDITIONAL         ? Expression::IFF     :
+                                        top.type == Token::EXCLUSIVE_DISJUNCTION ? Expression::XOR     :
+                                        top.type == Token::ALTERNATIVE_DENIAL    ? Expression::NAND    : Expression::NOR;
+                _operands[_operand_count - 1] = node(kind, _operands[_operand_count - 1], right);
+            }
+        }
+
+        StaticExpression<N> _result{};
+        StaticToken _tokens[N]{};
+        std::size_t _token_count{};
+        std::size_t _operators[N]{};    // Indices of the tokens on the operator stack.
+        std::size_t _operator_count{};
+        std::uint32_t _operands[N]{};
+        std::size_t _operand_count{};
+        std::uint32_t _slots[256]{};
+};
+
+template<std::size_t N>
+constexpr StaticExpression<N> parseStatic(const char (&source)[N]) {
+    return StaticParser<N>().parse(source);
+}
+
+// Evaluates the formula E, a StaticExpression with static storage, with every
+// node expanded inline at compile time.
+template<const auto& E>
+class StaticFormula {
+    static_assert(E.valid, "The formula does not parse, see its error_message and error_column.");
+    static_assert(E.variable_count <= CompiledFormula::MAX_VARIABLES, "Too many propositions.");
+
+    public:
+        static constexpr int variableCount() {return E.variable_count;}
+
+        static constexpr std::uint64_t rowCount() {return std::uint64_t{1} << E.variable_count;}
+
+        // Evaluates the formula for the assignment encoded by row.
+        static constexpr bool eval(std::uint64_t row) {
+            return value<E.node_count - 1, bool>([row](std::uint32_t slot) {
+                return !((row >> (E.variable_count - 1 - slot)) & 1);
+            });
+        }
+
+        // Evaluates the 64 rows starting at firstRow (a multiple of 64) at
+        // once, bit k of the result being row firstRow + k.
+        static constexpr std::uint64_t evalBlock(std::uint64_t firstRow) {
+            return value<E.node_count - 1, std::uint64_t>([firstRow](std::uint32_t slot) {
+                // Same columns as CompiledFormula::column().
+                constexpr std::uint64_t patterns[] = {
+                    0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+                    0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+                };
+                int bit = E.variable_count - 1 - static_cast<int>(slot);
+                if(bit < 6) return ~patterns[bit];
+                return ((firstRow >> bit) & 1) ? std::uint64_t{0} : ~std::uint64_t{0};
+            });
+        }
+
+        // Number of rows for which the formula is true.
+        static constexpr std::uint64_t countSatisfying() {
+            std::uint64_t count = 0;
+            for(std::uint64_t first = 0; first < rowCount(); first += 64) {
+                count += CompiledFormula::popCount(evalBlock(first) & CompiledFormula::blockMask(rowCount() - first));
+            }
+            return count;
+        }
+
+    private:
+        // Value of node I, with Value either a single truth value (bool) or
+        // 64 of them (a word). column(slot) gives the value of a proposition.
+        template<std::size_t I, class Value, class Column>
+        static constexpr Value value(const Column& column) {
+            constexpr Expression::Kind kind = E.kinds[I];
+            constexpr Value all = std::is_same<Value, bool>::value ? Value(true) : Value(~std::uint64_t{0});
+            if constexpr(kind == Expression::FALSE_CONSTANT) {
+                return Value(0);
+            } else if constexpr(kind == Expression::TRUE_CONSTANT) {
+                return all;
+            } else if constexpr(kind == Expression::VARIABLE) {
+                return column(E.lefts[I]);
+            } else if constexpr(kind == Expression::NOT) {
+                return value<E.lefts[I], Value>(column) ^ all;
+            } else {
+                Value left = value<E.lefts[I], Value>(column);
+                Value right = value<E.rights[I], Value>(column);
+                if constexpr(kind == Expression::AND) return left & right;
+                else if constexpr(kind == Expression::OR) return left | right;
+                else if constexpr(kind == Expression::IMPLIES) return (left ^ all) | right;
+                else if constexpr(kind == Expression::IFF) return (left ^ right) ^ all;
+                else if constexpr(kind == Expression::XOR) return left ^ right;
+                else if constexpr(kind == Expression::NAND) return (left & right) ^ all;
+                else return (left | right) ^ all;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,1831 @@
+/*
+    Program: truth_table.cpp
+    Purpose: Implementation of the expression engine declared in truth_table.h.
+    Written in C++17.
+*/
+
+#include "truth_table.h"
+
+#include <iostream>
+#include <stack>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+#ifdef TTG_JIT
+    #include <mutex>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+#ifdef TTG_X86_KERNELS
+    #include <immintrin.h>
+#endif
+
+void Lexer::scan(std::string_view source) {
+    _source = source;
+    _tokens.clear();
+    _propositions.clear();
+    std::fill(std::begin(_first_seen), std::end(_first_seen), -1);
+    _start_position = _current_position = 0;
+    while(!endReached()) {
+        _start_position = _current_position;
+        scanToken();
+    }
+    // Number the propositions in sorted order, the order the table lists them
+    // in, and only then hand the numbers out to the tokens.
+    int ids[256];
+    for(int c = 0; c < 256; ++c) {
+        if(_first_seen[c] < 0) continue;
+        ids[c] = static_cast<int>(_propositions.size());
+        _propositions.push_back(_source.substr(_first_seen[c], 1));
+    }
+    for(Token& t : _tokens) {
+        if(t.type() == Token::PROPOSITION) t.setId(ids[static_cast<unsigned char>(t.lexeme()[0])]);
+    }
+}
+
+void Lexer::scanToken() {
+    switch(_source[_current_position]) {
+        // =========================================================
+        // Ignore Whitespace
+        case ' ':
+            break;
+        // =========================================================
+        // Truth values
+        case '0':
+        case 'F':
+            addToken(Token::Type::TRUTH_VALUE, false);
+            break;
+        case '1':
+        case 'T':
+            addToken(Token::Type::TRUTH_VALUE, true);
+            break;
+        // =========================================================
+        // Parentheses
+        case '(':
+            addToken(Token::Type::LPAREN, Token::Precedence::NA);
+            break;
+        case ')':
+            addToken(Token::Type::RPAREN, Token::Precedence::NA);
+            break;
+        // =========================================================
+        // Single-char operators
+        case '^':
+        case '*':
+            addToken(Token::Type::CONJUNCTION, Token::Precedence::L2);
+            break;
+        case 'v':
+        case '+':
+            addToken(Token::Type::DISJUNCTION, Token::Precedence::L3);
+            break;
+        case '|':
+            addToken(Token::Type::ALTERNATIVE_DENIAL, Token::Precedence::L2);
+            break;
+        case '#':
+            addToken(Token::Type::JOINT_DENIAL, Token::Precedence::L3);
+            break;
+        case '!':
+        case '~':
+            addToken(Token::Type::NEGATION, Token::Precedence::L1);
+            break;
+        // =========================================================
+        // Multi-char operators
+        case '-':
+            if(matchNext('>')) addToken(Token::Type::IMPLICATION, Token::Precedence::L4);
+            break;
+        case '<':
+            // "<->" and "<+>" only differ in their middle character.
+            if(matchNext('-')) {
+                if(matchNext('>')) addToken(Token::Type::BICONDITIONAL, Token::Precedence::L5);
+            } else if(!endReached() && _source[_current_position] == '+' && matchNext('>')) {
+                addToken(Token::Type::EXCLUSIVE_DISJUNCTION, Token::Precedence::L5);
+            }
+            break;
+        // =========================================================
+        // Propositional Variables
+        default: {
+            addToken(Token::Type::PROPOSITION);
+            int& seen = _first_seen[static_cast<unsigned char>(_source[_current_position])];
+            if(seen < 0) seen = static_cast<int>(_current_position);
+            break;
+        }
+        // =========================================================
+    }
+    ++_current_position;
+}
+
+const void Lexer::Print() const {
+    for(std::size_t i{}; i < _tokens.size(); ++i) {
+        std::cout << i + 1 << ". Type: " << _tokens[i].type() << ", Lexeme: " << _tokens[i].lexeme() << std::endl;
+    }
+}
+
+bool validateTokenString(const std::vector<Token>& tokens) {
+    thread_local Parser parser;
+    return parser.parse(tokens);
+}
+
+// Shunting yard algorithm is used here.
+std::vector<Token> toPostFix(const std::vector<Token>& tokens) {
+    std::stack<Token> operators;
+    std::vector<Token> output;
+
+    for(const Token& t : tokens) {
+        if(t.isOperator()) {
+            while(!operators.empty() && t.precedence() > operators.top().precedence()) {
+                output.push_back(operators.top());
+                operators.pop();
+            }
+            operators.push(t);
+        } else if(t.type() == Token::LPAREN) {
+            operators.push(t);
+        } else if(t.type() == Token::RPAREN) {
+            while(!operators.empty() && operators.top().type() != Token::LPAREN) {
+                output.push_back(operators.top());
+                operators.pop();
+            }
+            if(!operators.empty()) operators.pop();
+        } else {
+            output.push_back(t);
+        }
+    }
+    while(!operators.empty()) {
+        if(operators.top().type() != Token::LPAREN) output.push_back(operators.top());
+        operators.pop();
+    }
+    return output;
+}
+
+// The tokens alternate between expecting an operand (a value, a proposition,
+// or something that starts one: a negation or a '(') and expecting what may
+// follow a complete operand (a binary operator or a ')'). Every token is
+// checked against that as it is read, so no token is ever looked at out of
+// bounds, and operators are turned into nodes as soon as precedence allows.
+bool Parser::parse(const std::vector<Token>& tokens) {
+    int variables = 0;
+    for(const Token& t : tokens) {
+        if(t.type() == Token::PROPOSITION) variables = std::max(variables, t.id() + 1);
+    }
+    _expression.clear(variables);
+    _operators.clear();
+    _operands.clear();
+
+    bool expect_operand = true;
+    for(const Token& t : tokens) {
+        std::size_t column = t.position() + 1;
+        if(expect_operand) {
+            switch(t.type()) {
+                case Token::TRUTH_VALUE:
+                    _operands.push_back(_expression.add(t.value() ? Expression::TRUE_CONSTANT : Expression::FALSE_CONSTANT));
+                    expect_operand = false;
+                    break;
+                case Token::PROPOSITION:
+                    if(t.id() < 0) return fail("Proposition was not interned by a Lexer", column);
+                    _operands.push_back(_expression.add(Expression::VARIABLE, static_cast<std::uint32_t>(t.id())));
+                    expect_operand = false;
+                    break;
+                case Token::NEGATION:
+                case Token::LPAREN:
+                    _operators.push_back(&t);
+                    break;
+                default:
+                    return fail("Expected a proposition, a truth value, a negation or '('", column);
+            }
+        } else if(t.isOperator() && t.type() != Token::NEGATION) {
+            reduce(t.precedence());
+            _operators.push_back(&t);
+            expect_operand = true;
+        } else if(t.type() == Token::RPAREN) {
+            reduce(Token::NA);
+            if(_operators.empty()) return fail("Unmatched ')'", column);
+            _operators.pop_back();
+        } else {
+            return fail("Expected an operator or ')'", column);
+        }
+    }
+    if(tokens.empty()) return fail("Empty expression", 1);
+    if(expect_operand) return fail("Expression ends unexpectedly", tokens.back().position() + tokens.back().lexeme().size() + 1);
+    reduce(Token::NA);
+    if(!_operators.empty()) return fail("Unmatched '('", _operators.back()->position() + 1);
+    return true;
+}
+
+void Parser::reduce(int precedence) {
+    while(!_operators.empty() && _operators.back()->type() != Token::LPAREN && precedence > _operators.back()->precedence()) {
+        Token::Type type = _operators.back()->type();
+        _operators.pop_back();
+        std::uint32_t right = _operands.back();
+        _operands.pop_back();
+        if(type == Token::NEGATION) {
+            _operands.push_back(_expression.add(Expression::NOT, right));
+            continue;
+        }
+        Expression::Kind kind = type == Token::CONJUNCTION           ? Expression::AND     :
+                                type == Token::DISJUNCTION           ? Expression::OR      :
+                                type == Token::IMPLICATION           ? Expression::IMPLIES :
+                                type == Token::BICONDITIONAL         ? Expression::IFF     :
+                                type == Token::EXCLUSIVE_DISJUNCTION ? Expression::XOR     :
+                                type == Token::ALTERNATIVE_DENIAL    ? Expression::NAND    : Expression::NOR;
+        _operands.back() = _expression.add(kind, _operands.back(), right);
+    }
+}
+
+// Number of operands a node of the given kind reads.
+static int operandCount(Expression::Kind kind) {
+    return kind <= Expression::VARIABLE ? 0 : kind == Expression::NOT ? 1 : 2;
+}
+
+namespace {
+
+// Builds an Expression node by node, folding constants and handing out the
+// existing node whenever an identical one is asked for.
+class ExpressionBuilder {
+    public:
+        ExpressionBuilder(int variableCount) {
+            _expression.clear(variableCount);
+        }
+
+        const Expression& expression() const {return _expression;}
+
+        std::uint32_t make(Expression::Kind kind, std::uint32_t left = 0, std::uint32_t right = 0) {
+            switch(kind) {
+                case Expression::NOT:
+                    if(is(left, Expression::TRUE_CONSTANT)) return make(Expression::FALSE_CONSTANT);
+                    if(is(left, Expression::FALSE_CONSTANT)) return make(Expression::TRUE_CONSTANT);
+                    if(is(left, Expression::NOT)) return node(left).left;
+                    // Every binary operator has one that gives the opposite
+                    // result, except ->, whose opposite is ^ with a negation.
+                    if(operandCount(node(left).kind) == 2 && node(left).kind != Expression::IMPLIES) {
+                        static const Expression::Kind opposites[] = {
+                            Expression::FALSE_CONSTANT, Expression::FALSE_CONSTANT, Expression::FALSE_CONSTANT, Expression::FALSE_CONSTANT,
+                            Expression::NAND, Expression::NOR, Expression::FALSE_CONSTANT, Expression::XOR,
+                            Expression::IFF, Expression::AND, Expression::OR
+                        };
+                        return make(opposites[node(left).kind], node(left).left, node(left).right);
+                    }
+                    break;
+                case Expression::AND:
+                    if(is(left, Expression::FALSE_CONSTANT) || is(right, Expression::FALSE_CONSTANT)) return make(Expression::FALSE_CONSTANT);
+                    if(is(left, Expression::TRUE_CONSTANT)) return right;
+                    if(is(right, Expression::TRUE_CONSTANT) || left == right) return left;
+                    if(complements(left, right)) return make(Expression::FALSE_CONSTANT);
+                    break;
+                case Expression::OR:
+                    if(is(left, Expression::TRUE_CONSTANT) || is(right, Expression::TRUE_CONSTANT)) return make(Expression::TRUE_CONSTANT);
+                    if(is(left, Expression::FALSE_CONSTANT)) return right;
+                    if(is(right, Expression::FALSE_CONSTANT) || left == right) return left;
+                    if(complements(left, right)) return make(Expression::TRUE_CONSTANT);
+                    break;
+                case Expression::IMPLIES:
+                    if(is(left, Expression::FALSE_CONSTANT) || is(right, Expression::TRUE_CONSTANT) || left == right) return make(Expression::TRUE_CONSTANT);
+                    if(is(left, Expression::TRUE_CONSTANT)) return right;
+                    if(is(right, Expression::FALSE_CONSTANT)) return make(Expression::NOT, left);
+                    // !x -> x and x -> !x are both just their right side.
+                    if(complements(left, right)) return right;
+                    break;
+                case Expression::IFF:
+                    if(is(left, Expression::TRUE_CONSTANT)) return right;
+                    if(is(right, Expression::TRUE_CONSTANT)) return left;
+                    if(is(left, Expression::FALSE_CONSTANT)) return make(Expression::NOT, right);
+                    if(is(right, Expression::FALSE_CONSTANT)) return make(Expression::NOT, left);
+                    if(left == right) return make(Expression::TRUE_CONSTANT);
+                    if(complements(left, right)) return make(Expression::FALSE_CONSTANT);
+                    break;
+                case Expression::XOR:
+                    if(is(left, Expression::FALSE_CONSTANT)) return right;
+                    if(is(right, Expression::FALSE_CONSTANT)) return left;
+                    if(is(left, Expression::TRUE_CONSTANT)) return make(Expression::NOT, right);
+                    if(is(right, Expression::TRUE_CONSTANT)) return make(Expression::NOT, left);
+                    if(left == right) return make(Expression::FALSE_CONSTANT);
+                    if(complements(left, right)) return make(Expression::TRUE_CONSTANT);
+                    break;
+                case Expression::NAND:
+                    if(is(left, Expression::FALSE_CONSTANT) || is(right, Expression::FALSE_CONSTANT)) return make(Expression::TRUE_CONSTANT);
+                    if(is(left, Expression::TRUE_CONSTANT)) return make(Expression::NOT, right);
+                    if(is(right, Expression::TRUE_CONSTANT) || left == right) return make(Expression::NOT, left);
+                    if(complements(left, right)) return make(Expression::TRUE_CONSTANT);
+                    break;
+                case Expression::NOR:
+                    if(is(left, Expression::TRUE_CONSTANT) || is(right, Expression::TRUE_CONSTANT)) return make(Expression::FALSE_CONSTANT);
+                    if(is(left, Expression::FALSE_CONSTANT)) return make(Expression::NOT, right);
+                    if(is(right, Expression::FALSE_CONSTANT) || left == right) return make(Expression::NOT, left);
+                    if(complements(left, right)) return make(Expression::FALSE_CONSTANT);
+                    break;
+                default:break;
+            }
+            // Operands of commutative operators are put in a fixed order so
+            // that p ^ q and q ^ p end up as the same node.
+            if(operandCount(kind) == 2 && kind != Expression::IMPLIES && left > right) std::swap(left, right);
+
+            Key key{kind, left, right};
+            auto found = _unique.find(key);
+            if(found != _unique.end()) return found->second;
+            std::uint32_t index = _expression.add(kind, left, right);
+            _unique.insert({key, index});
+            return index;
+        }
+
+    private:
+        struct Key {
+            Expression::Kind kind;
+            std::uint32_t left;
+            std::uint32_t right;
+            bool operator==(const Key& other) const {return kind == other.kind && left == other.left && right == other.right;}
+        };
+
+        struct KeyHash {
+            std::size_t operator()(const Key& key) const {
+                std::uint64_t h = (static_cast<std::uint64_t>(key.left) << 32 | key.right) * 0x9E3779B97F4A7C15ull;
+                return static_cast<std::size_t>(h ^ (h >> 29) ^ key.kind);
+            }
+        };
+
+        const Expression::Node& node(std::uint32_t index) const {return _expression.nodes()[index];}
+
+        bool is(std::uint32_t index, Expression::Kind kind) const {return node(index).kind == kind;}
+
+        // True if one of the nodes is the negation of the other.
+        bool complements(std::uint32_t a, std::uint32_t b) const {
+            return (is(a, Expression::NOT) && node(a).left == b) || (is(b, Expression::NOT) && node(b).left == a);
+        }
+
+        Expression _expression;
+        std::unordered_map<Key, std::uint32_t, KeyHash> _unique;
+};
+
+}
+
+Expression optimize(const Expression& expression) {
+    const std::vector<Expression::Node>& nodes = expression.nodes();
+    if(nodes.empty()) return expression;
+
+    ExpressionBuilder builder(expression.variableCount());
+    std::vector<std::uint32_t> rebuilt(nodes.size());
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        const Expression::Node& node = nodes[i];
+        int operands = operandCount(node.kind);
+        rebuilt[i] = builder.make(node.kind,
+                                  operands >= 1 ? rebuilt[node.left] : node.left,
+                                  operands == 2 ? rebuilt[node.right] : 0);
+    }
+
+    // Folding leaves behind nodes that nothing refers to any more, keep only
+    // what the root depends on. The root has the highest index among them, so
+    // it stays the last node.
+    const std::vector<Expression::Node>& built = builder.expression().nodes();
+    std::vector<char> needed(built.size(), false);
+    needed[rebuilt.back()] = true;
+    for(std::size_t i = rebuilt.back() + 1; i-- > 0;) {
+        if(!needed[i]) continue;
+        int operands = operandCount(built[i].kind);
+        if(operands >= 1) needed[built[i].left] = true;
+        if(operands == 2) needed[built[i].right] = true;
+    }
+    Expression result;
+    result.clear(expression.variableCount());
+    std::vector<std::uint32_t> renumbered(built.size());
+    for(std::size_t i = 0; i <= rebuilt.back(); ++i) {
+        if(!needed[i]) continue;
+        const Expression::Node& node = built[i];
+        int operands = operandCount(node.kind);
+        renumbered[i] = result.add(node.kind,
+                                   operands >= 1 ? renumbered[node.left] : node.left,
+                                   operands == 2 ? renumbered[node.right] : 0);
+    }
+    return result;
+}
+
+CompiledFormula::CompiledFormula(const Expression& expression, const std::vector<std::string_view>& propositions) {
+    compile(expression, propositions);
+}
+
+CompiledFormula::CompiledFormula(const std::vector<Token>& tokens, const std::vector<std::string_view>& propositions) {
+    Parser parser;
+    if(parser.parse(tokens)) compile(optimize(parser.expression()), propositions);
+    else _valid = false;
+}
+
+Expression cofactor(const Expression& expression, int k, std::uint64_t prefix) {
+    Expression fixed;
+    fixed.clear(expression.variableCount());
+    for(const Expression::Node& node : expression.nodes()) {
+        if(node.kind == Expression::VARIABLE && static_cast<int>(node.left) < k) {
+            // A 0 bit means True, as in row numbers.
+            bool value = !((prefix >> (k - 1 - node.left)) & 1);
+            fixed.add(value ? Expression::TRUE_CONSTANT : Expression::FALSE_CONSTANT);
+        } else {
+            fixed.add(node.kind, node.left, node.right);
+        }
+    }
+    return optimize(fixed);
+}
+
+std::string formatExpression(const Expression& expression, std::uint32_t node, const std::vector<std::string_view>& names) {
+    // Precedence level of each kind, as in the Lexer, 0 for operands.
+    static const int levels[] = {0, 0, 0, 1, 2, 3, 4, 5, 5, 2, 3};
+    static const char* symbols[] = {"F", "T", "", "~", " ^ ", " v ", " -> ", " <-> ", " <+> ", " | ", " # "};
+    const Expression::Node& n = expression.nodes()[node];
+    auto operand = [&](std::uint32_t child, bool parenthesize) {
+        std::string text = formatExpression(expression, child, names);
+        return parenthesize ? "(" + text + ")" : text;
+    };
+    int level = levels[n.kind];
+    switch(n.kind) {
+        case Expression::FALSE_CONSTANT:
+        case Expression::TRUE_CONSTANT:
+            return symbols[n.kind];
+        case Expression::VARIABLE:
+            return std::string(names[n.left]);
+        case Expression::NOT:
+            return symbols[n.kind] + operand(n.left, levels[expression.nodes()[n.left].kind] > level);
+        default:
+            // Operators of one level group to the right, so only a left
+            // operand of the same level needs parentheses.
+            return operand(n.left, levels[expression.nodes()[n.left].kind] >= level) + symbols[n.kind] +
+                   operand(n.right, levels[expression.nodes()[n.right].kind] > level);
+    }
+}
+
+SplitFormula::SplitFormula(const Expression& expression, const std::vector<std::string_view>& propositions, int k)
+    : _expression(expression), _names(propositions.begin(), propositions.end()), _current(Expression(), propositions) {
+    _split_count = std::max(0, std::min(k, variableCount() - 6));
+}
+
+CompiledFormula& SplitFormula::cofactorFor(std::uint64_t row) {
+    std::uint64_t prefix = _split_count ? row >> (variableCount() - _split_count) : 0;
+    if(!_compiled || prefix != _current_prefix) {
+        if(_compiled) _retired_operations += _current.operationCount();
+        std::vector<std::string_view> names(_names.begin(), _names.end());
+        _current = CompiledFormula(cofactor(_expression, _split_count, prefix), names);
+        if(_native) _current.enableNative();
+        _current_prefix = prefix;
+        _compiled = true;
+    }
+    return _current;
+}
+
+bool SplitFormula::enableNative() {
+#ifdef TTG_JIT
+    _native = true;
+    if(_compiled) _current.enableNative();
+    return true;
+#else
+    return false;
+#endif
+}
+
+template<class Work>
+void SplitFormula::forEachBlock(std::uint64_t first, std::uint64_t count, Work work) {
+    std::uint64_t end = first + count;
+    while(first < end) {
+        std::uint64_t block_end = std::min(end, (first / blockRows() + 1) * blockRows());
+        if(work(cofactorFor(first), first, block_end - first)) return;
+        first = block_end;
+    }
+}
+
+void SplitFormula::evalBlock(std::uint64_t startRow, std::uint64_t count, std::uint64_t* outBits) {
+    // Blocks are at least 64 rows, so every one starts on a word.
+    forEachBlock(startRow, count, [&](CompiledFormula& formula, std::uint64_t first, std::uint64_t rows) {
+        formula.evalBlock(first, rows, outBits + (first - startRow) / 64);
+        return false;
+    });
+}
+
+std::uint64_t SplitFormula::countSatisfying(std::uint64_t first, std::uint64_t count) {
+    std::uint64_t total = 0;
+    forEachBlock(first, count, [&](CompiledFormula& formula, std::uint64_t start, std::uint64_t rows) {
+        total += formula.countSatisfying(start, rows);
+        return false;
+    });
+    return total;
+}
+
+std::uint64_t SplitFormula::firstSatisfying(std::uint64_t first, std::uint64_t count) {
+    return findFirst(true, first, count);
+}
+
+std::uint64_t SplitFormula::firstFalsifying(std::uint64_t first, std::uint64_t count) {
+    return findFirst(false, first, count);
+}
+
+std::uint64_t SplitFormula::findFirst(bool value, std::uint64_t first, std::uint64_t count) {
+    std::uint64_t found = first + count;
+    forEachBlock(first, count, [&](CompiledFormula& formula, std::uint64_t start, std::uint64_t rows) {
+        std::uint64_t row = value ? formula.firstSatisfying(start, rows) : formula.firstFalsifying(start, rows);
+        if(row == start + rows) return false;
+        found = row;
+        return true;
+    });
+    return found;
+}
+
+BigUnsigned::BigUnsigned(std::uint64_t value) {
+    for(; value; value >>= 32) _limbs.push_back(static_cast<std::uint32_t>(value));
+}
+
+void BigUnsigned::trim() {
+    while(!_limbs.empty() && _limbs.back() == 0) _limbs.pop_back();
+}
+
+BigUnsigned& BigUnsigned::operator+=(const BigUnsigned& other) {
+    if(_limbs.size() < other._limbs.size()) _limbs.resize(other._limbs.size(), 0);
+    std::uint64_t carry = 0;
+    for(std::size_t i = 0; i < _limbs.size(); ++i) {
+        carry += _limbs[i];
+        if(i < other._limbs.size()) carry += other._limbs[i];
+        _limbs[i] = static_cast<std::uint32_t>(carry);
+        carry >>= 32;
+    }
+    if(carry) _limbs.push_back(static_cast<std::uint32_t>(carry));
+    return *this;
+}
+
+BigUnsigned& BigUnsigned::operator<<=(unsigned bits) {
+    if(_limbs.empty()) return *this;
+    _limbs.insert(_limbs.begin(), bits / 32, 0);
+    if(bits % 32) {
+        std::uint32_t carry = 0;
+        for(std::uint32_t& limb : _limbs) {
+            std::uint32_t next = limb >> (32 - bits % 32);
+            limb = (limb << (bits % 32)) | carry;
+            carry = next;
+        }
+        if(carry) _limbs.push_back(carry);
+    }
+    return *this;
+}
+
+std::string BigUnsigned::toString() const {
+    if(_limbs.empty()) return "0";
+    // Divides by 10 ^ 9 repeatedly, each remainder gives 9 digits.
+    std::vector<std::uint32_t> value = _limbs;
+    std::string digits;
+    while(!value.empty()) {
+        std::uint64_t remainder = 0;
+        for(std::size_t i = value.size(); i-- > 0;) {
+            std::uint64_t current = (remainder << 32) | value[i];
+            value[i] = static_cast<std::uint32_t>(current / 1000000000);
+            remainder = current % 1000000000;
+        }
+        while(!value.empty() && value.back() == 0) value.pop_back();
+        for(int d = 0; d < 9 && (remainder || !value.empty()); ++d, remainder /= 10) {
+            digits += static_cast<char>('0' + remainder % 10);
+        }
+    }
+    return std::string(digits.rbegin(), digits.rend());
+}
+
+std::size_t BDD::NodeHash::operator()(const Node& node) const {
+    std::uint64_t h = (static_cast<std::uint64_t>(node.low) << 32 | node.high) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h ^ (h >> 29) ^ node.slot);
+}
+
+BDD::BDD(int variableCount) : _variable_count(variableCount) {
+    std::uint32_t terminal = static_cast<std::uint32_t>(variableCount);
+    _nodes.push_back({terminal, FALSE_NODE, FALSE_NODE});
+    _nodes.push_back({terminal, TRUE_NODE, TRUE_NODE});
+    _cache.assign(1 << 12, CacheEntry{TRUE_NODE, TRUE_NODE, TRUE_NODE, Expression::FALSE_CONSTANT});
+}
+
+BDD::Ref BDD::make(std::uint32_t slot, Ref low, Ref high) {
+    if(low == high) return low;
+    Node node{slot, low, high};
+    auto found = _unique.find(node);
+    if(found != _unique.end()) return found->second;
+    Ref ref = static_cast<Ref>(_nodes.size());
+    _nodes.push_back(node);
+    _unique.insert({node, ref});
+    // The cache grows with the diagram, so hits do not get rarer as it does.
+    if(_nodes.size() > 4 * _cache.size()) {
+        _cache.assign(2 * _cache.size(), CacheEntry{TRUE_NODE, TRUE_NODE, TRUE_NODE, Expression::FALSE_CONSTANT});
+    }
+    return ref;
+}
+
+BDD::Ref BDD::variable(int slot) {
+    return make(static_cast<std::uint32_t>(slot), FALSE_NODE, TRUE_NODE);
+}
+
+BDD::Ref BDD::apply(Expression::Kind operation, Ref f, Ref g) {
+    // Cases settled without looking into either diagram.
+    switch(operation) {
+        case Expression::AND:
+            if(f == FALSE_NODE || g == FALSE_NODE) return FALSE_NODE;
+            if(f == TRUE_NODE || f == g) return g;
+            if(g == TRUE_NODE) return f;
+            break;
+        case Expression::OR:
+            if(f == TRUE_NODE || g == TRUE_NODE) return TRUE_NODE;
+            if(f == FALSE_NODE || f == g) return g;
+            if(g == FALSE_NODE) return f;
+            break;
+        case Expression::IMPLIES:
+            if(f == FALSE_NODE || g == TRUE_NODE || f == g) return TRUE_NODE;
+            if(f == TRUE_NODE) return g;
+            break;
+        case Expression::IFF:
+            if(f == g) return TRUE_NODE;
+            if(f == TRUE_NODE) return g;
+            if(g == TRUE_NODE) return f;
+            break;
+        case Expression::XOR:
+            if(f == g) return FALSE_NODE;
+            if(f == FALSE_NODE) return g;
+            if(g == FALSE_NODE) return f;
+            break;
+        case Expression::NAND:
+            if(f == FALSE_NODE || g == FALSE_NODE) return TRUE_NODE;
+            if(f == TRUE_NODE || f == g) return negate(g);
+            if(g == TRUE_NODE) return negate(f);
+            break;
+        case Expression::NOR:
+            if(f == TRUE_NODE || g == TRUE_NODE) return FALSE_NODE;
+            if(f == FALSE_NODE || f == g) return negate(g);
+            if(g == FALSE_NODE) return negate(f);
+            break;
+        default:
+            return FALSE_NODE;
+    }
+    if(operation != Expression::IMPLIES && f > g) std::swap(f, g);
+
+    std::size_t index = (static_cast<std::size_t>(f) * 0x9E3779B1u + g * 0x85EBCA77u + operation) & (_cache.size() - 1);
+    {
+        const CacheEntry& entry = _cache[index];
+        if(entry.f == f && entry.g == g && entry.operation == operation) return entry.result;
+    }
+
+    // Expands on the topmost slot of either diagram.
+    std::uint32_t slot = std::min(_nodes[f].slot, _nodes[g].slot);
+    Ref f_low = _nodes[f].slot == slot ? _nodes[f].low : f;
+    Ref f_high = _nodes[f].slot == slot ? _nodes[f].high : f;
+    Ref g_low = _nodes[g].slot == slot ? _nodes[g].low : g;
+    Ref g_high = _nodes[g].slot == slot ? _nodes[g].high : g;
+    Ref low = apply(operation, f_low, g_low);
+    Ref high = apply(operation, f_high, g_high);
+    Ref result = make(slot, low, high);
+
+    // make() may have grown the cache, so the index is worked out again.
+    index = (static_cast<std::size_t>(f) * 0x9E3779B1u + g * 0x85EBCA77u + operation) & (_cache.size() - 1);
+    _cache[index] = CacheEntry{f, g, result, operation};
+    return result;
+}
+
+BDD::Ref BDD::build(const Expression& expression) {
+    const std::vector<Expression::Node>& nodes = expression.nodes();
+    if(nodes.empty()) return FALSE_NODE;
+    std::vector<Ref> refs(nodes.size());
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        const Expression::Node& node = nodes[i];
+        switch(node.kind) {
+            case Expression::FALSE_CONSTANT: refs[i] = FALSE_NODE; break;
+            case Expression::TRUE_CONSTANT:  refs[i] = TRUE_NODE; break;
+            case Expression::VARIABLE:       refs[i] = variable(static_cast<int>(node.left)); break;
+            case Expression::NOT:            refs[i] = negate(refs[node.left]); break;
+            default:                         refs[i] = apply(node.kind, refs[node.left], refs[node.right]); break;
+        }
+    }
+    return refs.back();
+}
+
+BigUnsigned BDD::countModels(Ref f) const {
+    // Models of every node over the slots from its own down, worked out
+    // children first. A branch that skips slots counts once for every value
+    // they can take.
+    std::vector<Ref> order;
+    std::vector<char> seen(_nodes.size(), false);
+    std::vector<Ref> pending{f};
+    while(!pending.empty()) {
+        Ref ref = pending.back();
+        if(ref <= TRUE_NODE || seen[ref]) {
+            pending.pop_back();
+            continue;
+        }
+        const Node& node = _nodes[ref];
+        bool low_done = node.low <= TRUE_NODE || seen[node.low];
+        bool high_done = node.high <= TRUE_NODE || seen[node.high];
+        if(low_done && high_done) {
+            seen[ref] = true;
+            order.push_back(ref);
+            pending.pop_back();
+        } else {
+            if(!low_done) pending.push_back(node.low);
+            if(!high_done) pending.push_back(node.high);
+        }
+    }
+
+    std::unordered_map<Ref, BigUnsigned> counts;
+    counts[FALSE_NODE] = BigUnsigned(0);
+    counts[TRUE_NODE] = BigUnsigned(1);
+    for(Ref ref : order) {
+        const Node& node = _nodes[ref];
+        BigUnsigned low = counts[node.low];
+        low <<= _nodes[node.low].slot - node.slot - 1;
+        BigUnsigned high = counts[node.high];
+        high <<= _nodes[node.high].slot - node.slot - 1;
+        low += high;
+        counts[ref] = low;
+    }
+    BigUnsigned total = counts[f];
+    total <<= _nodes[f].slot;
+    return total;
+}
+
+std::size_t BDD::size(Ref f) const {
+    std::vector<char> seen(_nodes.size(), false);
+    std::vector<Ref> pending{f};
+    std::size_t count = 0;
+    while(!pending.empty()) {
+        Ref ref = pending.back();
+        pending.pop_back();
+        if(seen[ref]) continue;
+        seen[ref] = true;
+        ++count;
+        if(ref > TRUE_NODE) {
+            pending.push_back(_nodes[ref].low);
+            pending.push_back(_nodes[ref].high);
+        }
+    }
+    return count;
+}
+
+void ResultTable::evalBlock(std::uint64_t startRow, std::uint64_t count, std::uint64_t* outBits) const {
+    const std::uint64_t* words = _bits->data() + startRow / 64;
+    std::uint64_t full = (count + 63) / 64;
+    std::copy(words, words + full, outBits);
+    outBits[full - 1] &= CompiledFormula::blockMask(count - 64 * (full - 1));
+}
+
+std::uint64_t ResultTable::countSatisfying(std::uint64_t first, std::uint64_t count) const {
+    std::uint64_t total = 0;
+    for(std::uint64_t done = 0; done < count; done += 64) {
+        total += CompiledFormula::popCount((*_bits)[(first + done) / 64] & CompiledFormula::blockMask(count - done));
+    }
+    return total;
+}
+
+std::uint64_t ResultTable::firstSatisfying(std::uint64_t first, std::uint64_t count) const {
+    for(std::uint64_t done = 0; done < count; done += 64) {
+        std::uint64_t hits = (*_bits)[(first + done) / 64] & CompiledFormula::blockMask(count - done);
+        if(hits) return first + done + CompiledFormula::countTrailingZeros(hits);
+    }
+    return first + count;
+}
+
+std::uint64_t ResultTable::firstFalsifying(std::uint64_t first, std::uint64_t count) const {
+    for(std::uint64_t done = 0; done < count; done += 64) {
+        std::uint64_t hits = ~(*_bits)[(first + done) / 64] & CompiledFormula::blockMask(count - done);
+        if(hits) return first + done + CompiledFormula::countTrailingZeros(hits);
+    }
+    return first + count;
+}
+
+ColumnFormula::ColumnFormula(const Expression& expression, const std::vector<std::uint32_t>& columns)
+    : _nodes(expression.nodes()), _columns(columns), _values(expression.nodes().size(), 0) {
+    _variable_count = expression.variableCount();
+    // Nodes only refer to nodes before them, so going backwards marks
+    // everything below a column before it is visited.
+    std::vector<char> needed(_nodes.size(), false);
+    for(std::uint32_t c : _columns) needed[c] = true;
+    for(std::size_t i = _nodes.size(); i-- > 0;) {
+        if(!needed[i]) continue;
+        int operands = operandCount(_nodes[i].kind);
+        if(operands >= 1) needed[_nodes[i].left] = true;
+        if(operands == 2) needed[_nodes[i].right] = true;
+    }
+    for(std::uint32_t i = 0; i < _nodes.size(); ++i) {
+        if(needed[i]) _needed.push_back(i);
+    }
+}
+
+void ColumnFormula::evalBlock(std::uint64_t firstRow, std::uint64_t* out) {
+    std::uint64_t* v = _values.data();
+    for(std::uint32_t i : _needed) {
+        const Expression::Node& node = _nodes[i];
+        switch(node.kind) {
+            case Expression::FALSE_CONSTANT: v[i] = 0; break;
+            case Expression::TRUE_CONSTANT:  v[i] = ~std::uint64_t{0}; break;
+            case Expression::VARIABLE:       v[i] = CompiledFormula::slotColumn(_variable_count, node.left, firstRow); break;
+            case Expression::NOT:            v[i] = ~v[node.left]; break;
+            case Expression::AND:            v[i] = v[node.left] & v[node.right]; break;
+            case Expression::OR:             v[i] = v[node.left] | v[node.right]; break;
+            case Expression::IMPLIES:        v[i] = ~v[node.left] | v[node.right]; break;
+            case Expression::IFF:            v[i] = ~(v[node.left] ^ v[node.right]); break;
+            case Expression::XOR:            v[i] = v[node.left] ^ v[node.right]; break;
+            case Expression::NAND:           v[i] = ~(v[node.left] & v[node.right]); break;
+            case Expression::NOR:            v[i] = ~(v[node.left] | v[node.right]); break;
+        }
+    }
+    _operations += _needed.size();
+    for(std::size_t c = 0; c < _columns.size(); ++c) out[c] = v[_columns[c]];
+}
+
+namespace {
+
+// The rows of a table of a given size as a bitset, with the cube operations
+// minimizeCover() is built from.
+class RowSet {
+    public:
+        RowSet(std::vector<std::uint64_t> words, int variables) : _words(std::move(words)) {
+            _rows = std::uint64_t{1} << variables;
+            _words.resize((_rows + 63) / 64);
+            _words.back() &= CompiledFormula::blockMask(_rows - 64 * (_words.size() - 1));
+        }
+
+        const std::vector<std::uint64_t>& words() const {return _words;}
+        bool has(std::uint64_t row) const {return (_words[row / 64] >> (row % 64)) & 1;}
+        void set(std::uint64_t row) {_words[row / 64] |= std::uint64_t{1} << (row % 64);}
+
+        // Calls visit(word, mask) for every word holding rows of the cube,
+        // mask being those rows. The rows of a cube within a word follow the
+        // six low row bits, the words it touches every combination of the
+        // high bits it does not care about.
+        template<class Visit>
+        void forEachWord(const Cube& cube, Visit visit) const {
+            std::uint64_t low = 0;
+            for(std::uint64_t p = 0; p < std::min<std::uint64_t>(64, _rows); ++p) {
+                if((p & cube.care & 63) == (cube.value & 63)) low |= std::uint64_t{1} << p;
+            }
+            std::uint64_t free = (~cube.care & (_rows - 1)) >> 6;
+            std::uint64_t base = cube.value >> 6;
+            std::uint64_t subset = 0;
+            do {
+                visit(base | subset, low);
+                subset = (subset - free) & free;
+            } while(subset != 0);
+        }
+
+        // True if every row of the cube is in the set.
+        bool covers(const Cube& cube) const {
+            bool all = true;
+            forEachWord(cube, [&](std::uint64_t w, std::uint64_t mask) {all = all && (_words[w] & mask) == mask;});
+            return all;
+        }
+
+        // Rows of the cube that are in the set.
+        std::uint64_t count(const Cube& cube) const {
+            std::uint64_t total = 0;
+            forEachWord(cube, [&](std::uint64_t w, std::uint64_t mask) {total += CompiledFormula::popCount(_words[w] & mask);});
+            return total;
+        }
+
+        void add(const Cube& cube) {forEachWord(cube, [&](std::uint64_t w, std::uint64_t mask) {_words[w] |= mask;});}
+        void remove(const Cube& cube) {forEachWord(cube, [&](std::uint64_t w, std::uint64_t mask) {_words[w] &= ~mask;});}
+
+        bool empty() const {
+            for(std::uint64_t w : _words) if(w) return false;
+            return true;
+        }
+
+    private:
+        std::vector<std::uint64_t> _words;
+        std::uint64_t _rows;
+};
+
+// Every prime implicant of on. An implicant whose free row bits are D and
+// whose other bits are those of row r is one exactly when all rows r ^ S
+// for S within D are on, so the implicants for D, as a bitset over r, are
+// those for D without its lowest bit b ANDed with themselves shifted by b.
+// They are prime when freeing no further bit still gives an implicant.
+std::vector<Cube> primeImplicants(const RowSet& on, int variables) {
+    static const std::uint64_t patterns[] = {
+        0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+        0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+    };
+    std::uint64_t sets = std::uint64_t{1} << variables;
+    std::size_t words = on.words().size();
+    std::vector<std::uint64_t> implicants(sets * words);
+    std::copy(on.words().begin(), on.words().end(), implicants.begin());
+    for(std::uint64_t d = 1; d < sets; ++d) {
+        int b = CompiledFormula::countTrailingZeros(d);
+        const std::uint64_t* from = &implicants[(d ^ (std::uint64_t{1} << b)) * words];
+        std::uint64_t* to = &implicants[d * words];
+        for(std::size_t w = 0; w < words; ++w) {
+            std::uint64_t flipped;
+            if(b >= 6) {
+                flipped = from[w ^ (std::size_t{1} << (b - 6))];
+            } else {
+                int shift = 1 << b;
+                flipped = ((from[w] >> shift) & ~patterns[b]) | ((from[w] & ~patterns[b]) << shift);
+            }
+            to[w] = from[w] & flipped;
+        }
+    }
+    std::vector<Cube> primes;
+    std::uint64_t all = sets - 1;
+    for(std::uint64_t d = 0; d < sets; ++d) {
+        for(std::size_t w = 0; w < words; ++w) {
+            std::uint64_t prime = implicants[d * words + w];
+            for(int b = 0; b < variables && prime; ++b) {
+                std::uint64_t wider = d | (std::uint64_t{1} << b);
+                if(wider != d) prime &= ~implicants[wider * words + w];
+            }
+            // Each implicant shows up once for every row it covers, it is
+            // taken at the row whose free bits are all 0.
+            for(; prime; prime &= prime - 1) {
+                std::uint64_t row = 64 * w + CompiledFormula::countTrailingZeros(prime);
+                if(row & d) continue;
+                primes.push_back({all & ~d, row});
+            }
+        }
+    }
+    return primes;
+}
+
+// Espresso style expansion: every row not yet covered is grown into a prime
+// by freeing one row bit after another, in the given order, as long as the
+// cube stays within on.
+void expandRows(const RowSet& on, int variables, bool low_first, std::vector<Cube>& primes) {
+    RowSet covered(std::vector<std::uint64_t>(on.words().size(), 0), variables);
+    std::uint64_t all = (std::uint64_t{1} << variables) - 1;
+    for(std::size_t w = 0; w < on.words().size(); ++w) {
+        for(std::uint64_t left = on.words()[w] & ~covered.words()[w]; left; left &= left - 1) {
+            std::uint64_t row = 64 * w + CompiledFormula::countTrailingZeros(left);
+            if(covered.has(row)) continue;
+            Cube cube{all, row};
+            for(int k = 0; k < variables; ++k) {
+                std::uint64_t bit = std::uint64_t{1} << (low_first ? k : variables - 1 - k);
+                Cube wider{cube.care & ~bit, cube.value & ~bit};
+                if(on.covers(wider)) cube = wider;
+            }
+            covered.add(cube);
+            primes.push_back(cube);
+        }
+    }
+}
+
+// Picks cubes out of candidates until they cover on: first those that alone
+// cover some row, then the one covering the most rows still uncovered, with
+// fewer literals breaking ties. Gains only go down as rows get covered, so
+// they are kept in a heap and only worked out again when they come up.
+std::vector<Cube> chooseCover(const RowSet& on, int variables, const std::vector<Cube>& candidates) {
+    std::vector<Cube> chosen;
+    RowSet left = on;
+    std::vector<std::uint16_t> covering(std::size_t{1} << variables, 0);
+    for(const Cube& cube : candidates) {
+        on.forEachWord(cube, [&](std::uint64_t w, std::uint64_t mask) {
+            for(std::uint64_t m = mask & on.words()[w]; m; m &= m - 1) {
+                std::uint16_t& c = covering[64 * w + CompiledFormula::countTrailingZeros(m)];
+                if(c < 0xFFFF) ++c;
+            }
+        });
+    }
+    std::vector<char> taken(candidates.size(), false);
+    for(std::size_t i = 0; i < candidates.size(); ++i) {
+        bool essential = false;
+        on.forEachWord(candidates[i], [&](std::uint64_t w, std::uint64_t mask) {
+            for(std::uint64_t m = mask & left.words()[w]; m && !essential; m &= m - 1) {
+                essential = covering[64 * w + CompiledFormula::countTrailingZeros(m)] == 1;
+            }
+        });
+        if(!essential) continue;
+        taken[i] = true;
+        chosen.push_back(candidates[i]);
+        left.remove(candidates[i]);
+    }
+
+    auto literals = [](const Cube& cube) {return CompiledFormula::popCount(cube.care);};
+    typedef std::pair<std::uint64_t, std::size_t> Gain;
+    auto less = [&](const Gain& a, const Gain& b) {
+        if(a.first != b.first) return a.first < b.first;
+        return literals(candidates[a.second]) > literals(candidates[b.second]);
+    };
+    std::vector<Gain> heap;
+    for(std::size_t i = 0; i < candidates.size(); ++i) {
+        if(!taken[i]) heap.push_back({left.count(candidates[i]), i});
+    }
+    std::make_heap(heap.begin(), heap.end(), less);
+    while(!heap.empty() && !left.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), less);
+        Gain top = heap.back();
+        heap.pop_back();
+        top.first = left.count(candidates[top.second]);
+        if(top.first == 0) continue;
+        if(!heap.empty() && less(top, heap.front())) {
+            heap.push_back(top);
+            std::push_heap(heap.begin(), heap.end(), less);
+            continue;
+        }
+        chosen.push_back(candidates[top.second]);
+        left.remove(candidates[top.second]);
+    }
+
+    // Greedy picks can make earlier ones redundant, drop any whose rows the
+    // others cover between them, that is all rows covered at least twice.
+    std::fill(covering.begin(), covering.end(), 0);
+    auto forEachRow = [&](const Cube& cube, auto visit) {
+        on.forEachWord(cube, [&](std::uint64_t w, std::uint64_t mask) {
+            for(std::uint64_t m = mask; m; m &= m - 1) visit(covering[64 * w + CompiledFormula::countTrailingZeros(m)]);
+        });
+    };
+    for(const Cube& cube : chosen) forEachRow(cube, [](std::uint16_t& c) {if(c < 0xFFFF) ++c;});
+    std::vector<Cube> irredundant;
+    for(std::size_t i = chosen.size(); i-- > 0;) {
+        bool redundant = true;
+        forEachRow(chosen[i], [&](std::uint16_t& c) {redundant = redundant && c >= 2;});
+        if(redundant) forEachRow(chosen[i], [](std::uint16_t& c) {if(c < 0xFFFF) --c;});
+        else irredundant.push_back(chosen[i]);
+    }
+    return irredundant;
+}
+
+// Builds a chain of the given operator over terms, grouped to the right so
+// it prints without parentheses.
+std::uint32_t chain(Expression& expression, Expression::Kind kind, const std::vector<std::uint32_t>& terms) {
+    std::uint32_t result = terms.back();
+    for(std::size_t i = terms.size() - 1; i-- > 0;) result = expression.add(kind, terms[i], result);
+    return result;
+}
+
+// The expression for a list of cubes: for a sum of products the OR of the
+// conjunctions of their literals, otherwise the AND of the disjunctions of
+// their complemented literals.
+Expression normalForm(const std::vector<Cube>& cubes, int variables, bool sum) {
+    Expression result;
+    result.clear(variables);
+    if(cubes.empty()) {
+        result.add(sum ? Expression::FALSE_CONSTANT : Expression::TRUE_CONSTANT);
+        return result;
+    }
+    std::vector<std::uint32_t> terms;
+    for(const Cube& cube : cubes) {
+        std::vector<std::uint32_t> literals;
+        for(int slot = 0; slot < variables; ++slot) {
+            std::uint64_t bit = std::uint64_t{1} << (variables - 1 - slot);
+            if(!(cube.care & bit)) continue;
+            // A set row bit means False, which a product negates and a sum,
+            // being the negation of the cube, does not.
+            std::uint32_t variable = result.add(Expression::VARIABLE, static_cast<std::uint32_t>(slot));
+            bool negated = ((cube.value & bit) != 0) == sum;
+            literals.push_back(negated ? result.add(Expression::NOT, variable) : variable);
+        }
+        if(literals.empty()) {
+            terms.push_back(result.add(sum ? Expression::TRUE_CONSTANT : Expression::FALSE_CONSTANT));
+        } else {
+            terms.push_back(chain(result, sum ? Expression::AND : Expression::OR, literals));
+        }
+    }
+    // The root is the last node added, a lone term being the last too.
+    chain(result, sum ? Expression::OR : Expression::AND, terms);
+    return result;
+}
+
+}
+
+std::vector<Cube> minimizeCover(const std::vector<std::uint64_t>& bits, int variables, bool value) {
+    std::vector<std::uint64_t> words(bits);
+    if(!value) {
+        for(std::uint64_t& w : words) w = ~w;
+    }
+    RowSet on(std::move(words), variables);
+    if(on.empty()) return {};
+
+    std::vector<Cube> candidates;
+    if(variables <= EXACT_MINIMIZE_VARIABLES) {
+        candidates = primeImplicants(on, variables);
+    } else {
+        // Two orders of expansion give primes that lean different ways,
+        // and more to choose the cover from.
+        expandRows(on, variables, true, candidates);
+        expandRows(on, variables, false, candidates);
+        std::sort(candidates.begin(), candidates.end(), [](const Cube& a, const Cube& b) {
+            return a.care != b.care ? a.care < b.care : a.value < b.value;
+        });
+        candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const Cube& a, const Cube& b) {
+            return a.care == b.care && a.value == b.value;
+        }), candidates.end());
+    }
+    std::vector<Cube> cover = chooseCover(on, variables, candidates);
+    std::sort(cover.begin(), cover.end(), [](const Cube& a, const Cube& b) {
+        return a.value != b.value ? a.value < b.value : a.care > b.care;
+    });
+    return cover;
+}
+
+Expression sumOfProducts(const std::vector<Cube>& cubes, int variables) {
+    return normalForm(cubes, variables, true);
+}
+
+Expression productOfSums(const std::vector<Cube>& cubes, int variables) {
+    return normalForm(cubes, variables, false);
+}
+
+Expression cheapestForm(const Expression& expression, const std::vector<std::string_view>& propositions) {
+    int variables = static_cast<int>(propositions.size());
+    if(variables > CHEAPEST_FORM_VARIABLES) return expression;
+    // A program of a few instructions per proposition is about as small as
+    // a normal form gets, those are left alone.
+    CompiledFormula compiled(expression, propositions);
+    if(compiled.instructionCount() <= 4 * propositions.size()) return expression;
+    std::vector<std::uint64_t> bits((compiled.rowCount() + 63) / 64);
+    compiled.evalBlock(0, compiled.rowCount(), bits.data());
+
+    Expression best = expression;
+    std::size_t cost = compiled.instructionCount();
+    for(bool sum : {true, false}) {
+        std::vector<Cube> cover = minimizeCover(bits, variables, sum);
+        Expression candidate = optimize(sum ? sumOfProducts(cover, variables) : productOfSums(cover, variables));
+        std::size_t candidate_cost = CompiledFormula(candidate, propositions).instructionCount();
+        if(candidate_cost < cost) {
+            best = std::move(candidate);
+            cost = candidate_cost;
+        }
+    }
+    return best;
+}
+
+std::string FormulaCache::canonicalForm(const Expression& expression) {
+    // Every distinct subexpression gets a number that only depends on what it
+    // is, not on where it sits in the graph: the nodes are numbered a height
+    // at a time, those of one height in the order of their kind and the
+    // numbers of their operands, sorted for commutative operators. The form
+    // lists each number's node once, so it grows with the graph, not with
+    // the tree the graph unfolds to.
+    const std::vector<Expression::Node>& nodes = expression.nodes();
+    std::string result = std::to_string(expression.variableCount()) + ':';
+    if(nodes.empty()) return result;
+
+    // Only the nodes the root uses count, children come before their parents.
+    std::vector<char> used(nodes.size(), 0);
+    used[expression.root()] = 1;
+    for(std::size_t i = nodes.size(); i-- > 0;) {
+        if(!used[i]) continue;
+        int operands = operandCount(nodes[i].kind);
+        if(operands >= 1) used[nodes[i].left] = 1;
+        if(operands == 2) used[nodes[i].right] = 1;
+    }
+    std::vector<std::uint32_t> height(nodes.size(), 0);
+    std::vector<std::vector<std::uint32_t>> levels;
+    for(std::uint32_t i = 0; i < nodes.size(); ++i) {
+        if(!used[i]) continue;
+        int operands = operandCount(nodes[i].kind);
+        if(operands >= 1) height[i] = height[nodes[i].left] + 1;
+        if(operands == 2) height[i] = std::max(height[i], height[nodes[i].right] + 1);
+        if(height[i] >= levels.size()) levels.resize(height[i] + 1);
+        levels[height[i]].push_back(i);
+    }
+
+    static const char symbols[] = {'F', 'T', 'x', '~', '^', 'v', '>', '=', '+', '|', '#'};
+    struct Key {
+        Expression::Kind kind;
+        std::uint32_t left;
+        std::uint32_t right;
+        bool operator<(const Key& other) const {
+            if(kind != other.kind) return kind < other.kind;
+            return left != other.left ? left < other.left : right < other.right;
+        }
+        bool operator!=(const Key& other) const {return kind != other.kind || left != other.left || right != other.right;}
+    };
+    std::vector<std::uint32_t> number(nodes.size(), 0);
+    std::uint32_t count = 0;
+    std::vector<std::pair<Key, std::uint32_t>> level;
+    for(const std::vector<std::uint32_t>& members : levels) {
+        level.clear();
+        for(std::uint32_t i : members) {
+            const Expression::Node& node = nodes[i];
+            Key key{node.kind, 0, 0};
+            int operands = operandCount(node.kind);
+            if(node.kind == Expression::VARIABLE) key.left = node.left;
+            if(operands >= 1) key.left = number[node.left];
+            if(operands == 2) {
+                key.right = number[node.right];
+                if(node.kind != Expression::IMPLIES && key.right < key.left) std::swap(key.left, key.right);
+            }
+            level.emplace_back(key, i);
+        }
+        std::sort(level.begin(), level.end(), [](const std::pair<Key, std::uint32_t>& a, const std::pair<Key, std::uint32_t>& b) {
+            return a.first < b.first;
+        });
+        for(std::size_t j = 0; j < level.size(); ++j) {
+            const Key& key = level[j].first;
+            if(j == 0 || key != level[j - 1].first) {
+                ++count;
+                int operands = operandCount(key.kind);
+                result += symbols[key.kind];
+                if(key.kind == Expression::VARIABLE || operands >= 1) result += std::to_string(key.left);
+                if(operands == 2) result += ',' + std::to_string(key.right);
+                result += ' ';
+            }
+            number[level[j].second] = count - 1;
+        }
+    }
+    // The root is the only node of the greatest height, so it is listed last.
+    return result;
+}
+
+std::size_t FormulaCache::sizeOf(const std::string& key, const Entry& entry) {
+    std::size_t size = 2 * key.size() + sizeof(Entry) + 16 * entry.formula.instructionCount();
+    if(entry.bits) size += 8 * entry.bits->size();
+    return size;
+}
+
+std::shared_ptr<const FormulaCache::Entry> FormulaCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _index.find(key);
+    if(found == _index.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    ++_hits;
+    _entries.splice(_entries.begin(), _entries, found->second);
+    return found->second->second;
+}
+
+void FormulaCache::insert(const std::string& key, std::shared_ptr<const Entry> entry) {
+    std::size_t size = sizeOf(key, *entry);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _index.find(key);
+    if(found != _index.end()) erase(found->second);
+    if(size > _max_bytes) return;
+    while(_bytes + size > _max_bytes) erase(std::prev(_entries.end()));
+    _entries.emplace_front(key, std::move(entry));
+    _index[key] = _entries.begin();
+    _bytes += size;
+}
+
+void FormulaCache::erase(EntryList::iterator it) {
+    _bytes -= sizeOf(it->first, *it->second);
+    _index.erase(it->first);
+    _entries.erase(it);
+}
+
+IncrementalFormula::IncrementalFormula(const Expression& expression)
+    : _nodes(expression.nodes()), _values(expression.nodes().size(), 0) {
+    _variable_count = expression.variableCount();
+
+    // Every node depends on the variables below it, tracked as a mask of row
+    // bits. Constants depend on nothing and are never recomputed.
+    std::vector<std::uint64_t> depends(_nodes.size(), 0);
+    for(std::size_t i = 0; i < _nodes.size(); ++i) {
+        const Expression::Node& node = _nodes[i];
+        int operands = operandCount(node.kind);
+        if(node.kind == Expression::VARIABLE) depends[i] = std::uint64_t{1} << (_variable_count - 1 - node.left);
+        if(operands >= 1) depends[i] |= depends[node.left];
+        if(operands == 2) depends[i] |= depends[node.right];
+    }
+    _dependent_start.assign(_variable_count + 1, 0);
+    for(int bit = 0; bit < _variable_count; ++bit) {
+        _dependent_start[bit] = _dependents.size();
+        for(std::uint32_t i = 0; i < _nodes.size(); ++i) {
+            if((depends[i] >> bit) & 1) _dependents.push_back(i);
+        }
+    }
+    _dependent_start[_variable_count] = _dependents.size();
+}
+
+void IncrementalFormula::update(std::uint32_t i) {
+    const Expression::Node& node = _nodes[i];
+    std::uint8_t* v = _values.data();
+    switch(node.kind) {
+        case Expression::FALSE_CONSTANT: v[i] = 0; break;
+        case Expression::TRUE_CONSTANT:  v[i] = 1; break;
+        case Expression::VARIABLE:       v[i] = ~(_row >> (_variable_count - 1 - node.left)) & 1; break;
+        case Expression::NOT:            v[i] = v[node.left] ^ 1; break;
+        case Expression::AND:            v[i] = v[node.left] & v[node.right]; break;
+        case Expression::OR:             v[i] = v[node.left] | v[node.right]; break;
+        case Expression::IMPLIES:        v[i] = (v[node.left] ^ 1) | v[node.right]; break;
+        case Expression::IFF:            v[i] = (v[node.left] ^ v[node.right]) ^ 1; break;
+        case Expression::XOR:            v[i] = v[node.left] ^ v[node.right]; break;
+        case Expression::NAND:           v[i] = (v[node.left] & v[node.right]) ^ 1; break;
+        case Expression::NOR:            v[i] = (v[node.left] | v[node.right]) ^ 1; break;
+    }
+}
+
+bool IncrementalFormula::reset(std::uint64_t row) {
+    _row = row;
+    _operations += _nodes.size();
+    for(std::uint32_t i = 0; i < _nodes.size(); ++i) update(i);
+    return result();
+}
+
+bool IncrementalFormula::flip(int bit) {
+    _row ^= std::uint64_t{1} << bit;
+    _operations += _dependent_start[bit + 1] - _dependent_start[bit];
+    for(std::size_t k = _dependent_start[bit]; k < _dependent_start[bit + 1]; ++k) update(_dependents[k]);
+    return result();
+}
+
+void CompiledFormula::compile(const Expression& expression, const std::vector<std::string_view>& propositions) {
+    // The Lexer already interned every proposition, so the evaluation loop
+    // never has to look one up by name.
+    _names.assign(propositions.begin(), propositions.end());
+    _variable_count = static_cast<int>(propositions.size());
+    _valid = !expression.nodes().empty();
+
+    // Nodes are stored children first, so they can be emitted in order. A
+    // register is freed at the last use of the value in it, and the node that
+    // uses it last may already write its result there, since every kernel
+    // reads an instruction's operands before writing its result.
+    const std::vector<Expression::Node>& nodes = expression.nodes();
+    std::vector<std::uint32_t> last_use(nodes.size(), 0);
+    std::vector<std::uint32_t> registers(nodes.size(), 0);
+    std::vector<std::uint32_t> free_registers;
+    for(std::uint32_t i = 0; i < nodes.size(); ++i) {
+        int operands = operandCount(nodes[i].kind);
+        if(operands >= 1) last_use[nodes[i].left] = i;
+        if(operands == 2) last_use[nodes[i].right] = i;
+    }
+
+    static const Opcode opcodes[] = {LOAD_FALSE, LOAD_TRUE, LOAD_VARIABLE, NOT, AND, OR, IMPLIES, IFF, XOR, NAND, NOR};
+    for(std::uint32_t i = 0; i < nodes.size(); ++i) {
+        const Expression::Node& node = nodes[i];
+        int operands = operandCount(node.kind);
+        Instruction in{opcodes[node.kind], 0, node.left, 0};
+        if(operands >= 1) in.left = registers[node.left];
+        if(operands == 2) in.right = registers[node.right];
+        if(operands >= 1 && last_use[node.left] == i) free_registers.push_back(in.left);
+        if(operands == 2 && last_use[node.right] == i && node.right != node.left) free_registers.push_back(in.right);
+        if(free_registers.empty()) {
+            registers[i] = _register_count++;
+        } else {
+            registers[i] = free_registers.back();
+            free_registers.pop_back();
+        }
+        in.dst = registers[i];
+        _program.push_back(in);
+    }
+    _result = _valid ? registers.back() : 0;
+    std::uint32_t size = std::max<std::uint32_t>(1, _register_count);
+    _registers.assign(size, 0);
+    _words.assign(size, 0);
+    _lanes.assign(size * 8, 0);
+    _kernel = bestKernel();
+}
+
+bool CompiledFormula::eval(std::uint64_t row) {
+    _operations += _program.size();
+    std::uint8_t* r = _registers.data();
+    for(const Instruction& in : _program) {
+        switch(in.opcode) {
+            case LOAD_FALSE:    r[in.dst] = 0; break;
+            case LOAD_TRUE:     r[in.dst] = 1; break;
+            case LOAD_VARIABLE: r[in.dst] = ~(row >> (_variable_count - 1 - in.left)) & 1; break;
+            case NOT:           r[in.dst] = r[in.left] ^ 1; break;
+            case AND:           r[in.dst] = r[in.left] & r[in.right]; break;
+            case OR:            r[in.dst] = r[in.left] | r[in.right]; break;
+            case IMPLIES:       r[in.dst] = (r[in.left] ^ 1) | r[in.right]; break;
+            case IFF:           r[in.dst] = (r[in.left] ^ r[in.right]) ^ 1; break;
+            case XOR:           r[in.dst] = r[in.left] ^ r[in.right]; break;
+            case NAND:          r[in.dst] = (r[in.left] & r[in.right]) ^ 1; break;
+            case NOR:           r[in.dst] = (r[in.left] | r[in.right]) ^ 1; break;
+        }
+    }
+    return r[_result] != 0;
+}
+
+bool CompiledFormula::eval(const std::vector<bool>& assignment) {
+    std::uint64_t row = 0;
+    for(int slot = 0; slot < _variable_count; ++slot) {
+        row = (row << 1) | !assignment.at(slot);
+    }
+    return eval(row);
+}
+
+void CompiledFormula::evalBlock(std::uint64_t startRow, std::uint64_t count, std::uint64_t* outBits) {
+    for(std::uint64_t done = 0; done < count; done += 64 * 64) {
+        std::size_t blocks = static_cast<std::size_t>(std::min<std::uint64_t>(64, (count - done + 63) / 64));
+        std::uint64_t* out = outBits + done / 64;
+        runBlocks(startRow + done, blocks, out);
+        out[blocks - 1] &= blockMask(count - done - 64 * (blocks - 1));
+    }
+}
+
+std::uint64_t CompiledFormula::countSatisfying() {
+    return countSatisfying(0, rowCount());
+}
+
+std::uint64_t CompiledFormula::countSatisfying(std::uint64_t first, std::uint64_t count) {
+    std::uint64_t total = 0;
+    std::uint64_t results[64];
+    for(std::uint64_t done = 0; done < count; done += 64 * 64) {
+        std::uint64_t rows = std::min<std::uint64_t>(64 * 64, count - done);
+        evalBlock(first + done, rows, results);
+        for(std::uint64_t b = 0; b < (rows + 63) / 64; ++b) total += popCount(results[b]);
+    }
+    return total;
+}
+
+std::uint64_t CompiledFormula::firstSatisfying(std::uint64_t first, std::uint64_t count) {
+    return findFirst(true, first, count);
+}
+
+std::uint64_t CompiledFormula::firstFalsifying(std::uint64_t first, std::uint64_t count) {
+    return findFirst(false, first, count);
+}
+
+std::uint64_t CompiledFormula::findFirst(bool value, std::uint64_t first, std::uint64_t count) {
+    // The first block is kept small, since a witness is often found right at
+    // the start, and the following ones grow up to 4096 rows.
+    std::uint64_t results[64];
+    std::uint64_t step = 64;
+    for(std::uint64_t done = 0; done < count; done += step, step = std::min<std::uint64_t>(64 * 64, 2 * step)) {
+        std::uint64_t rows = std::min(step, count - done);
+        evalBlock(first + done, rows, results);
+        for(std::uint64_t b = 0; b < (rows + 63) / 64; ++b) {
+            std::uint64_t hits = value ? results[b] : ~results[b] & blockMask(rows - 64 * b);
+            if(hits) return first + done + 64 * b + countTrailingZeros(hits);
+        }
+    }
+    return first + count;
+}
+
+#ifdef TTG_JIT
+// Straight-line x86-64 code for one formula, wrapped in a loop over blocks:
+//   void run(std::uint64_t firstRow, std::uint64_t* out, std::uint64_t count, std::uint64_t* spill)
+// leaves the result word of the block starting at firstRow + 64 * k in
+// out[k]. The first bytecode registers live in machine registers, the rest in
+// spill, and every instruction goes through r11.
+class NativeCode {
+    public:
+        typedef void (*Function)(std::uint64_t, std::uint64_t*, std::uint64_t, std::uint64_t*);
+
+        // The code for program, generated the first time it is asked for.
+        static std::shared_ptr<const NativeCode> get(const std::vector<CompiledFormula::Instruction>& program,
+                                                     std::uint32_t result, int variables);
+
+        NativeCode(void* memory, std::size_t size, Function function) : _memory(memory), _size(size), _function(function) {}
+        ~NativeCode() {munmap(_memory, _size);}
+
+        NativeCode(const NativeCode&) = delete;
+        NativeCode& operator=(const NativeCode&) = delete;
+
+        void run(std::uint64_t firstRow, std::uint64_t* out, std::uint64_t count, std::uint64_t* spill) const {
+            _function(firstRow, out, count, spill);
+        }
+
+    private:
+        void* _memory;
+        std::size_t _size;
+        Function _function;
+};
+
+namespace {
+
+// Machine register numbers.
+enum : int {RAX = 0, RCX = 1, RDX = 2, RBX = 3, RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9, R10, R11, R12, R13, R14, R15};
+
+// Registers free for bytecode registers, the rest hold the arguments, rcx
+// the spill area, and r11 the value being worked on.
+const int MACHINE_REGISTERS[] = {RAX, R8, R9, R10, RBX, RBP, R12, R13, R14, R15};
+const int SAVED_REGISTERS[] = {RBX, RBP, R12, R13, R14, R15};
+
+// Opcodes, the group ones take the operation in the ModRM reg field.
+const std::uint8_t MOV_LOAD = 0x8B, MOV_STORE = 0x89, AND_LOAD = 0x23, OR_LOAD = 0x0B, XOR_LOAD = 0x33, TEST = 0x85;
+const std::uint8_t GROUP_SHIFT = 0xC1, GROUP_IMM8 = 0x83, GROUP_UNARY = 0xF7, GROUP_INCDEC = 0xFF;
+const std::uint8_t JZ = 0x84, JNZ = 0x85;
+
+// Assembles the handful of 64 bit instructions the generated code uses.
+class Emitter {
+    public:
+        // Where a bytecode register lives: a machine register, or a slot of
+        // the spill area.
+        struct Place {
+            int reg;            // -1 when spilled.
+            std::int32_t disp;  // Offset into the spill area.
+        };
+
+        Place place(std::uint32_t r) const {
+            const std::uint32_t count = sizeof(MACHINE_REGISTERS) / sizeof(MACHINE_REGISTERS[0]);
+            if(r < count) return {MACHINE_REGISTERS[r], 0};
+            return {-1, static_cast<std::int32_t>(8 * (r - count))};
+        }
+
+        // opcode reg, place (or place, reg for stores), with reg in the
+        // ModRM reg field.
+        void rm(std::uint8_t opcode, int reg, Place at) {
+            int rm = at.reg < 0 ? RCX : at.reg;
+            byte(0x48 | ((reg >> 3) << 2) | (rm >> 3));
+            byte(opcode);
+            if(at.reg < 0) {
+                byte(0x80 | ((reg & 7) << 3) | RCX);
+                dword(static_cast<std::uint32_t>(at.disp));
+            } else {
+                byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+            }
+        }
+
+        // opcode reg, rm on two machine registers.
+        void rr(std::uint8_t opcode, int reg, int rm) {
+            byte(0x48 | ((reg >> 3) << 2) | (rm >> 3));
+            byte(opcode);
+            byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        void load(int reg, Place from) {rm(MOV_LOAD, reg, from);}
+        void store(Place to, int reg) {rm(MOV_STORE, reg, to);}
+
+        void immediate(int reg, std::uint64_t value) {
+            byte(0x48 | (reg >> 3));
+            byte(0xB8 | (reg & 7));
+            for(int b = 0; b < 8; ++b) byte(static_cast<std::uint8_t>(value >> (8 * b)));
+        }
+
+        // Group instructions on a register: opcode /extension, with an
+        // optional 8 bit immediate.
+        void group(std::uint8_t opcode, int extension, int reg, int imm8 = -1) {
+            rr(opcode, extension, reg);
+            if(imm8 >= 0) byte(static_cast<std::uint8_t>(imm8));
+        }
+
+        void push(int reg) {if(reg >> 3) byte(0x41); byte(0x50 | (reg & 7));}
+        void pop(int reg) {if(reg >> 3) byte(0x41); byte(0x58 | (reg & 7));}
+
+        // A 32 bit conditional jump whose target is patched in later,
+        // returning where.
+        std::size_t jump(std::uint8_t condition) {
+            byte(0x0F);
+            byte(condition);
+            dword(0);
+            return _code.size() - 4;
+        }
+
+        void patch(std::size_t at, std::size_t target) {
+            std::int32_t offset = static_cast<std::int32_t>(target - (at + 4));
+            for(int b = 0; b < 4; ++b) _code[at + b] = static_cast<std::uint8_t>(offset >> (8 * b));
+        }
+
+        void byte(std::uint8_t value) {_code.push_back(value);}
+        void dword(std::uint32_t value) {for(int b = 0; b < 4; ++b) byte(static_cast<std::uint8_t>(value >> (8 * b)));}
+
+        std::size_t size() const {return _code.size();}
+        const std::vector<std::uint8_t>& code() const {return _code;}
+
+    private:
+        std::vector<std::uint8_t> _code;
+};
+
+std::vector<std::uint8_t> generate(const std::vector<CompiledFormula::Instruction>& program, std::uint32_t result, int variables) {
+    static const std::uint64_t patterns[] = {
+        0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+        0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+    };
+    Emitter e;
+    for(int reg : SAVED_REGISTERS) e.push(reg);
+    e.rr(TEST, RDX, RDX);
+    std::size_t skip = e.jump(JZ);
+    std::size_t top = e.size();
+    for(const CompiledFormula::Instruction& in : program) {
+        switch(in.opcode) {
+            case CompiledFormula::LOAD_FALSE:
+                e.rr(XOR_LOAD, R11, R11);
+                break;
+            case CompiledFormula::LOAD_TRUE:
+                e.immediate(R11, ~std::uint64_t{0});
+                break;
+            case CompiledFormula::LOAD_VARIABLE: {
+                // Same as CompiledFormula::column().
+                int bit = variables - 1 - static_cast<int>(in.left);
+                if(bit < 6) {
+                    e.immediate(R11, ~patterns[bit]);
+                } else {
+                    e.rr(MOV_LOAD, R11, RDI);
+                    e.group(GROUP_SHIFT, 5, R11, bit);   // shr r11, bit
+                    e.group(GROUP_UNARY, 2, R11);        // not r11
+                    e.group(GROUP_IMM8, 4, R11, 1);      // and r11, 1
+                    e.group(GROUP_UNARY, 3, R11);        // neg r11
+                }
+                break;
+            }
+            case CompiledFormula::NOT:
+                e.load(R11, e.place(in.left));
+                e.group(GROUP_UNARY, 2, R11);
+                break;
+            case CompiledFormula::AND:
+                e.load(R11, e.place(in.left));
+                e.rm(AND_LOAD, R11, e.place(in.right));
+                break;
+            case CompiledFormula::OR:
+                e.load(R11, e.place(in.left));
+                e.rm(OR_LOAD, R11, e.place(in.right));
+                break;
+            case CompiledFormula::IMPLIES:
+                e.load(R11, e.place(in.left));
+                e.group(GROUP_UNARY, 2, R11);
+                e.rm(OR_LOAD, R11, e.place(in.right));
+                break;
+            case CompiledFormula::IFF:
+                e.load(R11, e.place(in.left));
+                e.rm(XOR_LOAD, R11, e.place(in.right));
+                e.group(GROUP_UNARY, 2, R11);
+                break;
+            case CompiledFormula::XOR:
+                e.load(R11, e.place(in.left));
+                e.rm(XOR_LOAD, R11, e.place(in.right));
+                break;
+            case CompiledFormula::NAND:
+                e.load(R11, e.place(in.left));
+                e.rm(AND_LOAD, R11, e.place(in.right));
+                e.group(GROUP_UNARY, 2, R11);
+                break;
+            case CompiledFormula::NOR:
+                e.load(R11, e.place(in.left));
+                e.rm(OR_LOAD, R11, e.place(in.right));
+                e.group(GROUP_UNARY, 2, R11);
+                break;
+        }
+        e.store(e.place(in.dst), R11);
+    }
+    // *out = result; firstRow += 64; ++out; loop while --count.
+    e.load(R11, e.place(result));
+    e.byte(0x4C); e.byte(MOV_STORE); e.byte(0x1E);   // mov [rsi], r11
+    e.group(GROUP_IMM8, 0, RDI, 64);
+    e.group(GROUP_IMM8, 0, RSI, 8);
+    e.group(GROUP_INCDEC, 1, RDX);
+    e.patch(e.jump(JNZ), top);
+    e.patch(skip, e.size());
+    for(int i = sizeof(SAVED_REGISTERS) / sizeof(SAVED_REGISTERS[0]); i-- > 0;) e.pop(SAVED_REGISTERS[i]);
+    e.byte(0xC3);
+    return e.code();
+}
+
+}
+
+std::shared_ptr<const NativeCode> NativeCode::get(const std::vector<CompiledFormula::Instruction>& program,
+                                                  std::uint32_t result, int variables) {
+    // The program with its result register and variable count is the
+    // normalized form of the formula, optimize() having merged everything
+    // that computes the same thing.
+    std::string key(reinterpret_cast<const char*>(&result), sizeof(result));
+    key.append(reinterpret_cast<const char*>(&variables), sizeof(variables));
+    for(const CompiledFormula::Instruction& in : program) {
+        key += static_cast<char>(in.opcode);
+        key.append(reinterpret_cast<const char*>(&in.dst), sizeof(in.dst));
+        key.append(reinterpret_cast<const char*>(&in.left), sizeof(in.left));
+        key.append(reinterpret_cast<const char*>(&in.right), sizeof(in.right));
+    }
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const NativeCode>> cache;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = cache.find(key);
+    if(found != cache.end()) return found->second;
+
+    std::vector<std::uint8_t> code = generate(program, result, variables);
+    long page = sysconf(_SC_PAGESIZE);
+    std::size_t size = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) return nullptr;
+    std::copy(code.begin(), code.end(), static_cast<std::uint8_t*>(memory));
+    // Never writable and executable at the same time.
+    if(mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    auto native = std::make_shared<const NativeCode>(memory, size, reinterpret_cast<Function>(memory));
+
+    // Code nobody uses any more is dropped once the cache gets big.
+    if(cache.size() >= 1024) {
+        for(auto it = cache.begin(); it != cache.end();) {
+            if(it->second.use_count() == 1) it = cache.erase(it);
+            else ++it;
+        }
+    }
+    cache.insert({key, native});
+    return native;
+}
+#endif
+
+bool CompiledFormula::enableNative() {
+#ifdef TTG_JIT
+    if(!_valid) return false;
+    if(!_native) _native = NativeCode::get(_program, _result, _variable_count);
+    return _native != nullptr;
+#else
+    return false;
+#endif
+}
+
+CompiledFormula::Kernel CompiledFormula::bestKernel() {
+#ifdef TTG_X86_KERNELS
+    static const Kernel best = __builtin_cpu_supports("avx512f") ? AVX512 :
+                               __builtin_cpu_supports("avx2")    ? AVX2   : SCALAR;
+    return best;
+#else
+    return SCALAR;
+#endif
+}
+
+std::uint64_t CompiledFormula::runBlock(std::uint64_t firstRow) {
+    std::uint64_t* r = _words.data();
+    for(const Instruction& in : _program) {
+        switch(in.opcode) {
+            case LOAD_FALSE:    r[in.dst] = 0;  break;
+            case LOAD_TRUE:     r[in.dst] = ~std::uint64_t{0}; break;
+            case LOAD_VARIABLE: r[in.dst] = column(in.left, firstRow); break;
+            case NOT:           r[in.dst] = ~r[in.left]; break;
+            case AND:           r[in.dst] = r[in.left] & r[in.right]; break;
+            case OR:            r[in.dst] = r[in.left] | r[in.right]; break;
+            case IMPLIES:       r[in.dst] = ~r[in.left] | r[in.right]; break;
+            case IFF:           r[in.dst] = ~(r[in.left] ^ r[in.right]); break;
+            case XOR:           r[in.dst] = r[in.left] ^ r[in.right]; break;
+            case NAND:          r[in.dst] = ~(r[in.left] & r[in.right]); break;
+            case NOR:           r[in.dst] = ~(r[in.left] | r[in.right]); break;
+        }
+    }
+    return r[_result];
+}
+
+void CompiledFormula::runBlocks(std::uint64_t firstRow, std::size_t count, std::uint64_t* out) {
+    _operations += count * _program.size();
+#ifdef TTG_JIT
+    if(_native) {
+        _native->run(firstRow, out, count, _words.data());
+        return;
+    }
+#endif
+    std::size_t done = 0;
+#ifdef TTG_X86_KERNELS
+    if(_kernel == AVX512) {
+        for(; done + 8 <= count; done += 8) runBlocksAvx512(firstRow + 64 * done, out + done);
+    }
+    if(_kernel >= AVX2) {
+        for(; done + 4 <= count; done += 4) runBlocksAvx2(firstRow + 64 * done, out + done);
+    }
+#endif
+    for(; done < count; ++done) out[done] = runBlock(firstRow + 64 * done);
+}
+
+// Row bits below 6 vary inside a block and follow fixed patterns, the rest
+// are the same for the whole block. As everywhere else a 0 bit means True,
+// hence the inversions.
+std::uint64_t CompiledFormula::column(std::uint32_t slot, std::uint64_t firstRow) const {
+    return slotColumn(_variable_count, slot, firstRow);
+}
+
+std::uint64_t CompiledFormula::slotColumn(int variables, std::uint32_t slot, std::uint64_t firstRow) {
+    static const std::uint64_t patterns[] = {
+        0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+        0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+    };
+    int bit = variables - 1 - static_cast<int>(slot);
+    if(bit < 6) return ~patterns[bit];
+    return ((firstRow >> bit) & 1) ? 0 : ~std::uint64_t{0};
+}
+
+#ifdef TTG_X86_KERNELS
+__attribute__((target("avx2")))
+static __m256i load256(const std::uint64_t* p) {return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));}
+__attribute__((target("avx2")))
+static void store256(std::uint64_t* p, __m256i v) {_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);}
+__attribute__((target("avx512f")))
+static __m512i load512(const std::uint64_t* p) {return _mm512_loadu_si512(p);}
+__attribute__((target("avx512f")))
+static void store512(std::uint64_t* p, __m512i v) {_mm512_storeu_si512(p, v);}
+
+// Same as runBlock(), over 4 blocks held in one 256-bit register.
+__attribute__((target("avx2")))
+void CompiledFormula::runBlocksAvx2(std::uint64_t firstRow, std::uint64_t* out) {
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    std::uint64_t* r = _lanes.data();
+    for(const Instruction& in : _program) {
+        std::uint64_t* dst = r + 4 * in.dst;
+        const std::uint64_t* left = r + 4 * in.left;
+        const std::uint64_t* right = r + 4 * in.right;
+        switch(in.opcode) {
+            case LOAD_FALSE:    store256(dst, _mm256_setzero_si256()); break;
+            case LOAD_TRUE:     store256(dst, ones); break;
+            case LOAD_VARIABLE:
+                for(int w = 0; w < 4; ++w) dst[w] = column(in.left, firstRow + 64 * w);
+                break;
+            case NOT:     store256(dst, _mm256_xor_si256(load256(left), ones)); break;
+            case AND:     store256(dst, _mm256_and_si256(load256(left), load256(right))); break;
+            case OR:      store256(dst, _mm256_or_si256(load256(left), load256(right))); break;
+            case IMPLIES: store256(dst, _mm256_or_si256(_mm256_xor_si256(load256(left), ones), load256(right))); break;
+            case IFF:     store256(dst, _mm256_xor_si256(_mm256_xor_si256(load256(left), load256(right)), ones)); break;
+            case XOR:     store256(dst, _mm256_xor_si256(load256(left), load256(right))); break;
+            case NAND:    store256(dst, _mm256_xor_si256(_mm256_and_si256(load256(left), load256(right)), ones)); break;
+            case NOR:     store256(dst, _mm256_xor_si256(_mm256_or_si256(load256(left), load256(right)), ones)); break;
+        }
+    }
+    store256(out, load256(r + 4 * _result));
+}
+
+// Same as runBlock(), over 8 blocks held in one 512-bit register. The ternary
+// logic instruction covers every operator in one step, using 0xF0 and 0xCC as
+// the truth tables of the first and second operand.
+__attribute__((target("avx512f")))
+void CompiledFormula::runBlocksAvx512(std::uint64_t firstRow, std::uint64_t* out) {
+    std::uint64_t* r = _lanes.data();
+    for(const Instruction& in : _program) {
+        std::uint64_t* dst = r + 8 * in.dst;
+        const std::uint64_t* left = r + 8 * in.left;
+        const std::uint64_t* right = r + 8 * in.right;
+        switch(in.opcode) {
+            case LOAD_FALSE:    store512(dst, _mm512_setzero_si512()); break;
+            case LOAD_TRUE:     store512(dst, _mm512_set1_epi64(-1)); break;
+            case LOAD_VARIABLE:
+                for(int w = 0; w < 8; ++w) dst[w] = column(in.left, firstRow + 64 * w);
+                break;
+            case NOT:     {__m512i a = load512(left); store512(dst, _mm512_ternarylogic_epi64(a, a, a, 0x0F)); break;}
+            case AND:     store512(dst, _mm512_and_si512(load512(left), load512(right))); break;
+            case OR:      store512(dst, _mm512_or_si512(load512(left), load512(right))); break;
+            case IMPLIES: {__m512i a = load512(left); store512(dst, _mm512_ternarylogic_epi64(a, load512(right), a, 0xCF)); break;}
+            case IFF:     {__m512i a = load512(left); store512(dst, _mm512_ternarylogic_epi64(a, load512(right), a, 0xC3)); break;}
+            case XOR:     store512(dst, _mm512_xor_si512(load512(left), load512(right))); break;
+            case NAND:    {__m512i a = load512(left); store512(dst, _mm512_ternarylogic_epi64(a, load512(right), a, 0x3F)); break;}
+            case NOR:     {__m512i a = load512(left); store512(dst, _mm512_ternarylogic_epi64(a, load512(right), a, 0x03)); break;}
+        }
+    }
+    store512(out, load512(r + 8 * _result));
+}
+#endif
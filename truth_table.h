@@ -0,0 +1,871 @@
+/*
+    Program: truth_table.h
+    Purpose: The expression engine behind truth_table_generator.cpp, usable on
+             its own: the Lexer, validateTokenString() and toPostFix()
+             pipeline, and CompiledFormula, which evaluates an expression
+             against any number of assignments, and BDD, which answers
+             questions about an expression without going through its rows.
+             Nothing in here reads or
+             writes iostreams, apart from Lexer::Print().
+    Written in C++17.
+*/
+
+#ifndef TRUTH_TABLE_H
+#define TRUTH_TABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <memory>
+#include <list>
+#include <mutex>
+
+// The AVX2 and AVX-512 kernels are compiled with per-function target
+// attributes and only run when CPUID says the processor supports them, so
+// nothing needs to be built with -mavx2 or -mavx512f.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define TTG_X86_KERNELS 1
+#endif
+
+// Formulas can also be compiled to x86-64 machine code, which needs memory
+// that can be made executable.
+#if defined(TTG_X86_KERNELS) && defined(__unix__)
+    #define TTG_JIT 1
+#endif
+
+// Machine code generated for a formula, see CompiledFormula::enableNative().
+class NativeCode;
+
+// Tokens do not own their lexeme, it is a view into the source the Lexer
+// scanned, so a Token is only usable while that source is alive.
+class Token {
+    public:
+        enum Type {
+            TRUTH_VALUE = 0,
+            PROPOSITION,
+            NEGATION,
+            CONJUNCTION,
+            DISJUNCTION,
+            IMPLICATION,
+            BICONDITIONAL,
+            EXCLUSIVE_DISJUNCTION,   // XOR.
+            ALTERNATIVE_DENIAL,      // NAND.
+            JOINT_DENIAL,            // NOR.
+            LPAREN,
+            RPAREN
+        };
+        enum Precedence {
+            L1, L2, L3, L4, L5, NA
+        };
+
+        Token() {
+            _type = TRUTH_VALUE;
+            _precedence = NA;
+            _value = false;
+            _lexeme = "null";
+        }
+
+        Token(Type type, Precedence precedence, bool value, std::string_view lexeme, std::size_t position = 0) {
+            _type = type;
+            _precedence = precedence;
+            _value = value;
+            _lexeme = lexeme;
+            _position = position;
+        }
+        const Type type() const {return _type;}
+        const int precedence() const {return _precedence;}
+        const bool value() const {return _value;}
+        const std::string_view lexeme() const {return _lexeme;}
+
+        // Where the lexeme starts in the source, counting from 0.
+        const std::size_t position() const {return _position;}
+
+        // The interned number of a PROPOSITION token: its position among the
+        // expression's propositions in sorted order. -1 for other tokens.
+        const int id() const {return _id;}
+        
+        const bool isOperator() const {
+            switch(_type) {
+                case NEGATION:
+                case CONJUNCTION:
+                case DISJUNCTION:
+                case IMPLICATION:
+                case BICONDITIONAL:
+                case EXCLUSIVE_DISJUNCTION:
+                case ALTERNATIVE_DENIAL:
+                case JOINT_DENIAL:
+                    return true;
+                default: return false;
+            }
+        }
+
+        // Will not do anything if the token does not represent propositional variable.
+        void setValue(bool value) {
+            if(_type == PROPOSITION)
+                _value = value;
+        }
+
+        // Will not do anything if the token does not represent propositional variable.
+        void setId(int id) {
+            if(_type == PROPOSITION)
+                _id = id;
+        }
+    private:
+        Type _type;
+        Precedence _precedence;
+        bool _value;
+        int _id{-1};
+        std::size_t _position{};
+        std::string_view _lexeme;
+};
+
+// inspired by https://craftinginterpreters.com/scanning.html
+//
+// A Lexer can be reused: scan() replaces the previous tokens while keeping the
+// storage they used, so once it has grown to fit the longest expression no
+// more allocation happens. Lexemes and proposition names are views into the
+// scanned source, which must stay alive for as long as they are used.
+class Lexer {
+    public:
+        Lexer() {}
+
+        Lexer(std::string_view source) {
+            scan(source);
+        }
+
+        // Lexes source, replacing the tokens of any earlier call.
+        void scan(std::string_view source);
+
+        const std::vector<Token>& getTokens() const {
+            return _tokens;
+        }
+
+        // Every distinct proposition, sorted, so that propositions[t.id()] is
+        // the name of proposition token t.
+        const std::vector<std::string_view>& getPropositions() const {
+            return _propositions;
+        }
+
+        // Lists the tokens on std::cout, for debugging.
+        const void Print() const;
+
+    private:
+        void scanToken();
+
+        void addToken(Token::Type type) {
+            _tokens.push_back(Token(type, Token::Precedence::NA, false, getCurrentLexeme(), _start_position));
+        }
+
+        void addToken(Token::Type type, Token::Precedence precedence) {
+            _tokens.push_back(Token(type, precedence, false, getCurrentLexeme(), _start_position));
+        }
+
+        void addToken(Token::Type type, bool value) {
+            _tokens.push_back(Token(type, Token::Precedence::NA, value, getCurrentLexeme(), _start_position));
+        }
+
+        std::string_view getCurrentLexeme() const {
+            return _source.substr(_start_position, _current_position - _start_position + 1);
+        }
+
+        bool matchNext(char c) {
+            ++_current_position;
+            if(endReached()) return false;
+            if(_source[_current_position] != c) return false;
+            return true;
+        }
+
+        const bool endReached() const {
+            return _current_position >= _source.size();
+        }
+
+        std::vector<Token> _tokens;
+        std::vector<std::string_view> _propositions;
+        // Propositions are single characters, so they are interned through a
+        // table indexed by character: where each one was first seen in the
+        // source, or -1.
+        int _first_seen[256];
+        std::string_view _source;
+        std::size_t _start_position{};
+        std::size_t _current_position{};
+};
+
+// Checks that tokens form a well formed expression, same as Parser::parse()
+// succeeding on them.
+bool validateTokenString(const std::vector<Token>& tokens);
+
+// Reorders tokens into post-fix form. tokens should be valid, unbalanced
+// parentheses are ignored rather than read past.
+std::vector<Token> toPostFix(const std::vector<Token>& tokens);
+
+// A parsed expression as a graph of operations. Nodes only refer to nodes
+// before them, so the node list is in evaluation order and the last node is
+// the root.
+class Expression {
+    public:
+        enum Kind : std::uint8_t {
+            FALSE_CONSTANT = 0,
+            TRUE_CONSTANT,
+            VARIABLE,
+            NOT,
+            AND,
+            OR,
+            IMPLIES,
+            IFF,
+            XOR,
+            NAND,
+            NOR
+        };
+
+        struct Node {
+            Kind kind;
+            std::uint32_t left;  // Operand of NOT, left operand, or slot of a VARIABLE.
+            std::uint32_t right; // Right operand of a binary operation.
+        };
+
+        const std::vector<Node>& nodes() const {return _nodes;}
+        std::uint32_t root() const {return static_cast<std::uint32_t>(_nodes.size() - 1);}
+        int variableCount() const {return _variable_count;}
+
+        void clear(int variableCount) {
+            _nodes.clear();
+            _variable_count = variableCount;
+        }
+
+        // Appends a node, returning its index.
+        std::uint32_t add(Kind kind, std::uint32_t left = 0, std::uint32_t right = 0) {
+            _nodes.push_back({kind, left, right});
+            return static_cast<std::uint32_t>(_nodes.size() - 1);
+        }
+
+    private:
+        std::vector<Node> _nodes;
+        int _variable_count{};
+};
+
+// Rewrites expression into an equivalent one that is cheaper to evaluate:
+// identical subexpressions are merged into one node (also when the operands
+// of a commutative operator are swapped), constants are folded away together
+// with the branches they decide (x ^ F, x v T, T -> x, ...), double negations
+// and operations on a value and itself or its negation are simplified, a
+// negated operation becomes the operation that gives the opposite result
+// (~(p ^ q) is p | q, ~(p <-> q) is p <+> q, ...), and nodes the root no
+// longer depends on are dropped.
+Expression optimize(const Expression& expression);
+
+// The Shannon cofactor of expression for the rows whose top k bits are
+// prefix: the first k propositions are replaced by the constants those rows
+// give them, and the result is optimized. Slots are left as they are, so the
+// cofactor takes the same row numbers as expression.
+Expression cofactor(const Expression& expression, int k, std::uint64_t prefix);
+
+// Writes node of expression, and everything below it, back out as text in
+// the Lexer's syntax, with names[slot] for the propositions. Only the
+// parentheses the precedence levels call for are written, and binary
+// operators are set off by spaces: "~(p ^ q) v r".
+std::string formatExpression(const Expression& expression, std::uint32_t node, const std::vector<std::string_view>& names);
+
+// Validates a token string and builds its Expression in one pass, with the
+// same precedence levels as toPostFix(): a lower level binds tighter and
+// operators of the same level group to the right. Like the Lexer it can be
+// reused, keeping its storage between calls.
+class Parser {
+    public:
+        // Returns false if tokens do not form a well formed expression, see
+        // errorMessage() and errorColumn() for why.
+        bool parse(const std::vector<Token>& tokens);
+
+        const Expression& expression() const {return _expression;}
+
+        const char* errorMessage() const {return _error_message;}
+
+        // Column of the source the error was found at, counting from 1.
+        std::size_t errorColumn() const {return _error_column;}
+
+    private:
+        // Pops operators off the stack while they bind tighter than an
+        // operator of the given precedence, or all up to a '(' for NA.
+        void reduce(int precedence);
+
+        bool fail(const char* message, std::size_t column) {
+            _error_message = message;
+            _error_column = column;
+            return false;
+        }
+
+        Expression _expression;
+        std::vector<const Token*> _operators;
+        std::vector<std::uint32_t> _operands;
+        const char* _error_message = "";
+        std::size_t _error_column{};
+};
+
+// Holds an expression that has already been parsed and lowered into a compact
+// instruction stream, so it can be evaluated against any number of truth value
+// assignments without being lexed or parsed again.
+//
+// Propositions are referred to by slot: their position among the sorted
+// propositions, which is the id the Lexer gave them. A row number supplies the
+// value of every slot at once, the first slot being its most significant bit,
+// with a 0 bit meaning True so that row 0 is the all-True row at the top of
+// the table.
+//
+// Evaluation reuses scratch storage inside the object, so one CompiledFormula
+// must not be evaluated from several threads at once; give each thread its own
+// copy instead, copies are cheap.
+class CompiledFormula {
+    public:
+        // One per Expression::Kind.
+        enum Opcode : std::uint8_t {
+            LOAD_FALSE = 0,
+            LOAD_TRUE,
+            LOAD_VARIABLE,
+            NOT,
+            AND,
+            OR,
+            IMPLIES,
+            IFF,
+            XOR,
+            NAND,
+            NOR
+        };
+
+        // Instructions work on a small register file: each one writes its
+        // result to register dst, reading its operands from registers left and
+        // right. Registers are reused once their value is no longer needed, so
+        // a value used in several places is computed only once, and the
+        // register file stays about as small as an operand stack would be.
+        struct Instruction {
+            Opcode opcode;
+            std::uint32_t dst;
+            std::uint32_t left;  // Slot for LOAD_VARIABLE.
+            std::uint32_t right;
+        };
+
+        // The SIMD kernels evaluate several 64-row blocks per instruction.
+        enum Kernel {
+            SCALAR = 0,
+            AVX2,   // 4 blocks (256 rows) per instruction.
+            AVX512  // 8 blocks (512 rows) per instruction.
+        };
+
+        // Row numbers are 64 bit, so a table can have at most 2 ^ 63 rows.
+        static const int MAX_VARIABLES = 63;
+
+        // propositions are the names from Lexer::getPropositions(), proposition
+        // ids become slots.
+        CompiledFormula(const Expression& expression, const std::vector<std::string_view>& propositions);
+
+        // Parses and optimizes tokens first, valid() is false if they do not
+        // parse.
+        CompiledFormula(const std::vector<Token>& tokens, const std::vector<std::string_view>& propositions);
+
+        // False if the tokens did not parse, run the formula only when this is
+        // true.
+        bool valid() const {return _valid;}
+
+        int variableCount() const {return _variable_count;}
+
+        // Instructions executed per evaluation.
+        std::size_t instructionCount() const {return _program.size();}
+
+        // Instructions executed so far, each one counted once per row for
+        // eval() and once per 64-row block for the bitsliced kernels.
+        std::uint64_t operationCount() const {return _operations;}
+
+        // Proposition names in slot order.
+        const std::vector<std::string>& propositionNames() const {return _names;}
+
+        // Gives the slots new names, e.g. for a formula that was compiled for
+        // an expression which only differs in the names of its propositions.
+        void renamePropositions(const std::vector<std::string_view>& propositions) {
+            _names.assign(propositions.begin(), propositions.end());
+        }
+
+        // Rows in the table. Only meaningful up to MAX_VARIABLES propositions.
+        std::uint64_t rowCount() const {return std::uint64_t{1} << _variable_count;}
+
+        // Evaluates the formula for the assignment encoded by row.
+        bool eval(std::uint64_t row);
+
+        // Evaluates the formula with assignment[slot] as the value of each
+        // proposition.
+        bool eval(const std::vector<bool>& assignment);
+
+        // Evaluates the count rows starting at startRow (a multiple of 64),
+        // storing their results as a bitset: bit k of outBits[w] is the row
+        // startRow + 64 * w + k. Fills (count + 63) / 64 words, with the bits
+        // past the last row cleared.
+        void evalBlock(std::uint64_t startRow, std::uint64_t count, std::uint64_t* outBits);
+
+        // Number of rows in the table for which the formula is true.
+        std::uint64_t countSatisfying();
+
+        // Same, over the count rows starting at first (a multiple of 64).
+        std::uint64_t countSatisfying(std::uint64_t first, std::uint64_t count);
+
+        // First row in [first, first + count) for which the formula is true,
+        // or first + count if there is none. first must be a multiple of 64.
+        // Stops as soon as a block containing one is found.
+        std::uint64_t firstSatisfying(std::uint64_t first, std::uint64_t count);
+
+        // Same, for the first row for which the formula is false.
+        std::uint64_t firstFalsifying(std::uint64_t first, std::uint64_t count);
+
+        // Picks the widest kernel the running processor supports.
+        static Kernel bestKernel();
+
+        // The 64 values slot takes across the block of a table of variables
+        // propositions starting at firstRow, one row per bit.
+        static std::uint64_t slotColumn(int variables, std::uint32_t slot, std::uint64_t firstRow);
+
+        Kernel kernel() const {return _kernel;}
+
+        // Lets callers force a narrower kernel, e.g. to compare results.
+        // Requests for a kernel the processor lacks fall back to the best one
+        // it has.
+        void setKernel(Kernel kernel) {
+            _kernel = kernel <= bestKernel() ? kernel : bestKernel();
+        }
+
+        // Evaluates blocks of rows with machine code generated for this
+        // formula from then on, instead of the bytecode interpreters. The code
+        // is cached by program, so formulas that optimize to the same program
+        // share it, also across copies and threads. Returns false, leaving
+        // the formula as it was, where native code is not supported.
+        bool enableNative();
+
+        bool native() const {return _native != nullptr;}
+
+        // Mask covering the first min(remaining, 64) bits of a block.
+        static constexpr std::uint64_t blockMask(std::uint64_t remaining) {
+            return remaining >= 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << remaining) - 1;
+        }
+
+        // Index of the lowest set bit, word must not be 0.
+        static constexpr int countTrailingZeros(std::uint64_t word) {
+        #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(word);
+        #else
+            int count = 0;
+            for(; !(word & 1); word >>= 1) ++count;
+            return count;
+        #endif
+        }
+
+        static constexpr int popCount(std::uint64_t word) {
+        #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_popcountll(word);
+        #else
+            int count = 0;
+            for(; word; word &= word - 1) ++count;
+            return count;
+        #endif
+        }
+
+    private:
+        void compile(const Expression& expression, const std::vector<std::string_view>& propositions);
+
+        // First row in the range for which the formula gives value.
+        std::uint64_t findFirst(bool value, std::uint64_t first, std::uint64_t count);
+
+        // Bitsliced evaluation: evaluates the 64 consecutive rows starting at
+        // firstRow (a multiple of 64) at once, one row per bit of a machine
+        // word. Bit k of the result holds the value of row firstRow + k. Bits
+        // for rows past the end of the table are meaningless when the table
+        // has fewer than 64 rows.
+        std::uint64_t runBlock(std::uint64_t firstRow);
+
+        // Evaluates count consecutive 64-row blocks starting at firstRow,
+        // storing one unmasked result word per block in out, using the
+        // selected kernel.
+        void runBlocks(std::uint64_t firstRow, std::size_t count, std::uint64_t* out);
+
+    #ifdef TTG_X86_KERNELS
+        // Same as runBlock(), over 4 and 8 blocks at a time.
+        __attribute__((target("avx2")))
+        void runBlocksAvx2(std::uint64_t firstRow, std::uint64_t* out);
+        __attribute__((target("avx512f")))
+        void runBlocksAvx512(std::uint64_t firstRow, std::uint64_t* out);
+    #endif
+
+        // The 64 values a slot takes across the block starting at firstRow.
+        std::uint64_t column(std::uint32_t slot, std::uint64_t firstRow) const;
+
+        std::vector<Instruction> _program;
+        std::vector<std::string> _names;
+        std::vector<std::uint8_t> _registers; // One byte per register, for single rows.
+        std::vector<std::uint64_t> _words;    // Same, for bitsliced evaluation.
+        std::vector<std::uint64_t> _lanes;    // Same, for the SIMD kernels, 8 words per register.
+        Kernel _kernel{SCALAR};
+        int _variable_count{};
+        std::uint32_t _register_count{};
+        std::uint32_t _result{};              // Register holding the final result.
+        bool _valid{true};
+        std::shared_ptr<const NativeCode> _native;
+        std::uint64_t _operations{};
+};
+
+// The results of a formula over its whole table, kept as a bitset laid out as
+// CompiledFormula::evalBlock() fills one. Answers the same queries as
+// CompiledFormula by reading the bits, so it can stand in for one. Copies
+// share the bits.
+class ResultTable {
+    public:
+        ResultTable(std::shared_ptr<const std::vector<std::uint64_t>> bits, const std::vector<std::string_view>& propositions)
+            : _bits(std::move(bits)), _names(propositions.begin(), propositions.end()) {}
+
+        int variableCount() const {return static_cast<int>(_names.size());}
+
+        const std::vector<std::string>& propositionNames() const {return _names;}
+
+        std::uint64_t rowCount() const {return std::uint64_t{1} << variableCount();}
+
+        // Nothing is evaluated, the bits are only read.
+        std::uint64_t operationCount() const {return 0;}
+
+        // Same as in CompiledFormula.
+        void evalBlock(std::uint64_t startRow, std::uint64_t count, std::uint64_t* outBits) const;
+        std::uint64_t countSatisfying(std::uint64_t first, std::uint64_t count) const;
+        std::uint64_t firstSatisfying(std::uint64_t first, std::uint64_t count) const;
+        std::uint64_t firstFalsifying(std::uint64_t first, std::uint64_t count) const;
+
+    private:
+        std::shared_ptr<const std::vector<std::uint64_t>> _bits;
+        std::vector<std::string> _names;
+};
+
+// Evaluates some of the nodes of an expression as columns of the table, for
+// showing intermediate results next to the propositions. Works 64 rows at a
+// time like the bitsliced kernels, computing only the nodes the chosen
+// columns depend on, so the cost follows the columns asked for. The nodes
+// are taken as they are, without optimizing, so every subexpression that was
+// written stays there. Rows are numbered as in CompiledFormula, and like it
+// one ColumnFormula must not be used from several threads at once.
+class ColumnFormula {
+    public:
+        // columns are indices into expression.nodes(), in the order the
+        // columns should come in.
+        ColumnFormula(const Expression& expression, const std::vector<std::uint32_t>& columns);
+
+        int variableCount() const {return _variable_count;}
+
+        std::uint64_t rowCount() const {return std::uint64_t{1} << _variable_count;}
+
+        std::size_t columnCount() const {return _columns.size();}
+
+        // Evaluates the 64 rows starting at firstRow (a multiple of 64),
+        // storing column c as a bitset in out[c]: bit k is row firstRow + k.
+        void evalBlock(std::uint64_t firstRow, std::uint64_t* out);
+
+        // Nodes computed so far, each one counted once per block.
+        std::uint64_t operationCount() const {return _operations;}
+
+    private:
+        std::vector<Expression::Node> _nodes;
+        std::vector<std::uint32_t> _needed;   // Nodes the columns depend on, in evaluation order.
+        std::vector<std::uint32_t> _columns;
+        std::vector<std::uint64_t> _values;   // Value of every node for the current block.
+        int _variable_count{};
+        std::uint64_t _operations{};
+};
+
+// A product of literals in row terms: the rows r with (r & care) == value.
+// Row bits are as in CompiledFormula, so a set bit of value means the
+// proposition is False and the literal is negated.
+struct Cube {
+    std::uint64_t care;
+    std::uint64_t value;
+};
+
+// Finds as few cubes as it can, each with as few literals as it can, that
+// together cover exactly the rows of a table where the result is value. bits
+// is the whole table of a formula of variables propositions, laid out as
+// CompiledFormula::evalBlock() fills it. Up to EXACT_MINIMIZE_VARIABLES
+// propositions every prime implicant is found, Quine-McCluskey style, and a
+// cover is chosen from them: the essential ones first, then greedily. Above
+// that an Espresso style heuristic expands every row not yet covered into a
+// prime and then picks a cover from those. Rows and cubes are handled as
+// bitsets throughout, bit k of word w being row 64 * w + k. The cubes come
+// ordered by their first row.
+std::vector<Cube> minimizeCover(const std::vector<std::uint64_t>& bits, int variables, bool value);
+
+const int EXACT_MINIMIZE_VARIABLES = 12;
+const int MAX_MINIMIZE_VARIABLES = 24;
+
+// The disjunction of the cubes, a sum of products. Empty is F.
+Expression sumOfProducts(const std::vector<Cube>& cubes, int variables);
+
+// The conjunction of the negations of the cubes, a product of sums, for
+// cubes that cover the false rows. Empty is T.
+Expression productOfSums(const std::vector<Cube>& cubes, int variables);
+
+// expression, or the minimized sum of products or product of sums of its
+// table if that compiles to fewer instructions. Only tried up to
+// CHEAPEST_FORM_VARIABLES propositions, where working it out takes about as
+// long as evaluating a few thousand rows; others come back as they are.
+Expression cheapestForm(const Expression& expression, const std::vector<std::string_view>& propositions);
+
+const int CHEAPEST_FORM_VARIABLES = 10;
+
+// Remembers compiled formulas, and their result tables where those were
+// worked out, under a canonical form of the expression, so a formula that is
+// asked for again is only looked up. The least recently used entries are
+// dropped to keep the total size under a bound. Safe to share between
+// threads.
+class FormulaCache {
+    public:
+        struct Entry {
+            CompiledFormula formula;
+            std::shared_ptr<const std::vector<std::uint64_t>> bits;  // Null if not worked out.
+        };
+
+        explicit FormulaCache(std::size_t maxBytes) : _max_bytes(maxBytes) {}
+
+        // The same text for every expression that has the same nodes up to
+        // the order of the operands of commutative operators, after
+        // optimize(). Propositions are named by slot, so expressions whose
+        // names differ but sort the same way share a form, and with it a
+        // result table, which is in slot order.
+        static std::string canonicalForm(const Expression& expression);
+
+        // The entry for key, marked as just used, or null if there is none.
+        std::shared_ptr<const Entry> find(const std::string& key);
+
+        // Adds or replaces the entry for key. An entry larger than the whole
+        // bound is not kept.
+        void insert(const std::string& key, std::shared_ptr<const Entry> entry);
+
+        std::size_t maxBytes() const {return _max_bytes;}
+        std::uint64_t hits() const {return _hits;}
+        std::uint64_t misses() const {return _misses;}
+
+    private:
+        typedef std::list<std::pair<std::string, std::shared_ptr<const Entry>>> EntryList;
+
+        static std::size_t sizeOf(const std::string& key, const Entry& entry);
+
+        void erase(EntryList::iterator it);
+
+        EntryList _entries;  // Most recently used first.
+        std::unordered_map<std::string, EntryList::iterator> _index;
+        std::size_t _bytes{};
+        std::size_t _max_bytes;
+        std::uint64_t _hits{};
+        std::uint64_t _misses{};
+        std::mutex _mutex;
+};
+
+// Evaluates an expression by Shannon expansion on its first few propositions.
+// Those are constant across blocks of consecutive rows, so every block is run
+// through the formula's cofactor for it, which is usually much smaller than
+// the full formula. Cofactors are compiled when first needed for a block, the
+// one for the current block is kept until another block is evaluated, so
+// going through the rows in order compiles each of them once.
+//
+// Has the same evaluation interface as CompiledFormula, and the same rule on
+// threads: give each its own copy.
+class SplitFormula {
+    public:
+        // Splits on the first k propositions, or fewer if that would leave
+        // blocks of less than 64 rows.
+        SplitFormula(const Expression& expression, const std::vector<std::string_view>& propositions, int k);
+
+        int variableCount() const {return _expression.variableCount();}
+
+        const std::vector<std::string>& propositionNames() const {return _names;}
+
+        std::uint64_t rowCount() const {return std::uint64_t{1} << variableCount();}
+
+        // Propositions actually split on.
+        int splitCount() const {return _split_count;}
+
+        // Same as in CompiledFormula, over every cofactor used so far.
+        std::uint64_t operationCount() const {return _retired_operations + (_compiled ? _current.operationCount() : 0);}
+
+        // Rows sharing one cofactor.
+        std::uint64_t blockRows() const {return std::uint64_t{1} << (variableCount() - _split_count);}
+
+        // The compiled cofactor for the block containing row.
+        CompiledFormula& cofactorFor(std::uint64_t row);
+
+        // Runs the cofactors as native code, see CompiledFormula.
+        bool enableNative();
+
+        // Same as in CompiledFormula, the ranges may span several blocks.
+        void evalBlock(std::uint64_t startRow, std::uint64_t count, std::uint64_t* outBits);
+        std::uint64_t countSatisfying(std::uint64_t first, std::uint64_t count);
+        std::uint64_t firstSatisfying(std::uint64_t first, std::uint64_t count);
+        std::uint64_t firstFalsifying(std::uint64_t first, std::uint64_t count);
+
+    private:
+        // Calls work(cofactor, first, count) for each block's part of the
+        // range, stopping early if it returns true.
+        template<class Work>
+        void forEachBlock(std::uint64_t first, std::uint64_t count, Work work);
+
+        std::uint64_t findFirst(bool value, std::uint64_t first, std::uint64_t count);
+
+        Expression _expression;
+        std::vector<std::string> _names;
+        int _split_count{};
+        CompiledFormula _current;
+        std::uint64_t _current_prefix{};
+        bool _compiled{false};
+        bool _native{false};
+        std::uint64_t _retired_operations{};  // Work done by earlier cofactors.
+};
+
+// Unsigned integer of any size, just enough of one for counting the models of
+// formulas with more propositions than fit in a row number.
+class BigUnsigned {
+    public:
+        BigUnsigned(std::uint64_t value = 0);
+
+        BigUnsigned& operator+=(const BigUnsigned& other);
+        BigUnsigned& operator<<=(unsigned bits);
+
+        bool operator==(const BigUnsigned& other) const {return _limbs == other._limbs;}
+        bool operator!=(const BigUnsigned& other) const {return _limbs != other._limbs;}
+
+        // In decimal.
+        std::string toString() const;
+
+    private:
+        void trim();
+
+        std::vector<std::uint32_t> _limbs; // Least significant first, no leading zeros.
+};
+
+// A reduced ordered binary decision diagram of expressions over a fixed set of
+// slots, in slot order. Equivalent functions always get the same node, so
+// tautology, contradiction and equivalence checks are comparisons, and models
+// are counted in time proportional to the size of the diagram rather than the
+// number of rows. All diagrams built by one BDD share their nodes.
+class BDD {
+    public:
+        typedef std::uint32_t Ref;
+
+        // The two terminals.
+        static constexpr Ref FALSE_NODE = 0;
+        static constexpr Ref TRUE_NODE = 1;
+
+        explicit BDD(int variableCount);
+
+        int variableCount() const {return _variable_count;}
+
+        // The function that is just the proposition in slot.
+        Ref variable(int slot);
+
+        Ref negate(Ref f) {return apply(Expression::IMPLIES, f, FALSE_NODE);}
+
+        // Combines f and g with one of the binary operations of Expression.
+        Ref apply(Expression::Kind operation, Ref f, Ref g);
+
+        // The diagram for the root of expression, which must use at most
+        // variableCount() slots.
+        Ref build(const Expression& expression);
+
+        bool isTautology(Ref f) const {return f == TRUE_NODE;}
+        bool isContradiction(Ref f) const {return f == FALSE_NODE;}
+        bool equivalent(Ref f, Ref g) const {return f == g;}
+
+        // Assignments of all variableCount() slots for which f is true.
+        BigUnsigned countModels(Ref f) const;
+
+        // Nodes reachable from f, terminals included.
+        std::size_t size(Ref f) const;
+
+        // Nodes created so far, terminals included.
+        std::size_t nodeCount() const {return _nodes.size();}
+
+    private:
+        struct Node {
+            std::uint32_t slot;  // variableCount() for the terminals.
+            Ref low;             // Where to go if the slot is False.
+            Ref high;            // Where to go if it is True.
+        };
+
+        struct NodeHash {
+            std::size_t operator()(const Node& node) const;
+        };
+
+        struct NodeEqual {
+            bool operator()(const Node& a, const Node& b) const {return a.slot == b.slot && a.low == b.low && a.high == b.high;}
+        };
+
+        // One slot of the computed cache, which remembers recent apply()
+        // results and is overwritten on collisions.
+        struct CacheEntry {
+            Ref f;
+            Ref g;
+            Ref result;
+            Expression::Kind operation;
+        };
+
+        // The node for slot with the given branches, reusing an existing
+        // one, or just low when both branches are the same.
+        Ref make(std::uint32_t slot, Ref low, Ref high);
+
+        std::vector<Node> _nodes;
+        std::unordered_map<Node, Ref, NodeHash, NodeEqual> _unique;
+        std::vector<CacheEntry> _cache;
+        int _variable_count;
+};
+
+// Evaluates an expression one row at a time in Gray code order, where
+// consecutive rows differ in a single proposition. Every node keeps its value
+// from the previous row, and flipping a proposition only recomputes the nodes
+// that depend on it, in evaluation order. The propositions in the low row bits
+// flip most often, and typically feed only a small part of the expression.
+//
+// Rows are numbered as in CompiledFormula. Like it, one IncrementalFormula
+// must not be used from several threads at once.
+class IncrementalFormula {
+    public:
+        IncrementalFormula(const Expression& expression);
+
+        int variableCount() const {return _variable_count;}
+
+        std::uint64_t rowCount() const {return std::uint64_t{1} << _variable_count;}
+
+        // The row visited at position index of the Gray code order.
+        static std::uint64_t grayRow(std::uint64_t index) {return index ^ (index >> 1);}
+
+        // The row bit that changes between positions index - 1 and index,
+        // index must not be 0.
+        static int grayBit(std::uint64_t index) {return CompiledFormula::countTrailingZeros(index);}
+
+        // Evaluates every node for row, returning the result.
+        bool reset(std::uint64_t row);
+
+        // Moves to the row that differs from the current one in row bit bit,
+        // recomputing only what depends on it, and returns the result.
+        bool flip(int bit);
+
+        std::uint64_t row() const {return _row;}
+
+        bool result() const {return !_values.empty() && _values.back();}
+
+        // Nodes recomputed when row bit bit flips.
+        std::size_t dependentCount(int bit) const {return _dependent_start[bit + 1] - _dependent_start[bit];}
+
+        // Nodes computed so far.
+        std::uint64_t operationCount() const {return _operations;}
+
+    private:
+        void update(std::uint32_t node);
+
+        std::vector<Expression::Node> _nodes;
+        std::vector<std::uint8_t> _values;          // Value of every node for the current row.
+        std::vector<std::uint32_t> _dependents;     // Nodes depending on each row bit, grouped by bit.
+        std::vector<std::size_t> _dependent_start;  // Where each bit's group starts, plus the end.
+        std::uint64_t _row{};
+        int _variable_count{};
+        std::uint64_t _operations{};
+};
+
+#endif
@@ -13,376 +13,1760 @@
              - DISJUNCTION:     v, +.
              - IMPLICATION:     ->.
              - BICONDITIONAL:   <->
+             - EXCLUSIVE OR:    <+>
+             - NAND:            |
+             - NOR:             #
              
              NOTE: Type "quit" to exit the program.
+
+             Command line options:
+             - --batch [FILE]:      evaluate one expression per line of FILE or
+                                    stdin, without prompts and with tab
+                                    separated output.
+             - --binary FILE:       write the result column to FILE as a packed
+                                    bitset, one bit per row.
+             - --count:             only print how many rows are true.
+             - --first:             only print the first row that is true.
+             - --only-true:         only print the rows that are true.
+             - --only-false:        only print the rows that are false.
+             - --sat:               only tell whether some row is true,
+                                    printing the first one.
+             - --valid:             only tell whether every row is true,
+                                    printing the first one that is not.
+             - --dnf:               print a minimized sum of products with
+                                    the same table, in the syntax above.
+             - --cnf:               same, a minimized product of sums.
+             - --bits:              print the result column as a packed
+                                    bitset, after a line giving the number
+                                    of rows and of bytes.
+             - --bdd:               decide whether the expression is a
+                                    tautology or a contradiction and count
+                                    its true rows with a BDD, without
+                                    enumerating them.
+             - --equiv FORMULA:     same, also telling whether the expression
+                                    is equivalent to FORMULA.
+             - --gray:              print the table in Gray code order, one
+                                    proposition changes from row to row.
+             - --columns WHICH:     print only some columns of the table:
+                                    "result", "all" for every proposition
+                                    and subexpression, or a comma separated
+                                    list of propositions and subexpressions.
+             - --split K:           evaluate each assignment of the first K
+                                    propositions through its own cofactor.
+             - --jit:               evaluate through machine code generated for
+                                    the expression, where supported.
+             - --cache MB:          remember up to MB megabytes of compiled
+                                    formulas and result tables, so repeated
+                                    expressions are looked up.
+             - --shard K/N:         only go through the K-th of N equal slices of
+                                    the rows, counting from 0; see shard_merge.cpp
+                                    for putting the slices back together.
+             - --threads N:         evaluate rows on N threads (0 = one per core).
+             - --chunk-size ROWS:   rows handed to a thread at a time.
+             - --max-memory MB:     keep at most MB megabytes of output
+                                    waiting to be written, see
+                                    boundedOptions().
+             - --stats:             when done, print per-phase times and
+                                    counters as JSON to stderr.
+             - --serve PATH:        answer requests on a Unix socket at PATH,
+                                    one expression per line, see runServer().
     
+             The expression engine itself lives in truth_table.h, this file
+             is the command line front end.
+
     Date: 7/11/2024
     Written in C++17.        
 */
 
 
+#include "truth_table.h"
+
 #include <iostream>
 #include <string>
 #include <vector>
-#include <stack>
 #include <map>
-#include <iomanip>
+#include <deque>
+#include <sstream>
+#include <fstream>
+#include <cstdint>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <tuple>
+#include <optional>
+#include <utility>
+#include <chrono>
+#include <ctime>
+#include <streambuf>
 
-class Token {
-    public:
-        enum Type {
-            TRUTH_VALUE = 0,
-            PROPOSITION,
-            NEGATION,
-            CONJUNCTION,
-            DISJUNCTION,
-            IMPLICATION,
-            BICONDITIONAL,
-            LPAREN,
-            RPAREN
-        };
-        enum Precedence {
-            L1, L2, L3, L4, L5, NA
-        };
+// Binary output maps its file into memory where the platform allows it, and
+// --serve needs Unix sockets.
+#if defined(__unix__) || defined(__APPLE__)
+    #define TTG_POSIX 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <csignal>
+#endif
+
+// Counters and timers filled in with --stats and printed as JSON when the
+// program ends. Workers add to them from several threads. Without --stats
+// Options::stats is null and every hook costs one test of that pointer.
+struct Stats {
+    enum Phase {
+        LEX = 0,    // Lexer::scan().
+        PARSE,      // Validation and parsing, Parser::parse().
+        OPTIMIZE,   // optimize().
+        COMPILE,    // Lowering to bytecode, and to machine code with --jit.
+        EVALUATE,   // Running the formula over the rows, or building the BDD.
+        FORMAT,     // Turning results into table text.
+        OUTPUT,     // Handing table text to the output stream.
+        PHASE_COUNT
+    };
+    // Summed over every thread that spent time in the phase, so with more
+    // than one thread wall time can exceed the time the program ran.
+    std::atomic<std::uint64_t> wall_ns[PHASE_COUNT] = {};
+    std::atomic<std::uint64_t> cpu_ns[PHASE_COUNT] = {};
+    std::atomic<std::uint64_t> expressions{0};     // Expressions that parsed.
+    std::atomic<std::uint64_t> rows{0};            // Rows answered for, or searched by --first, --sat and --valid.
+    std::atomic<std::uint64_t> operations{0};      // Formula operations executed, see CompiledFormula::operationCount().
+    std::atomic<std::uint64_t> bytes_written{0};   // Bytes written to standard output.
+    std::atomic<std::uint64_t> writes{0};          // Writes to standard output.
+    std::atomic<std::uint64_t> flushes{0};         // Flushes of standard output.
 
-        Token() {
-            _type = TRUTH_VALUE;
-            _precedence = NA;
-            _value = false;
-            _lexeme = "null";
+    void print(std::ostream& out) const {
+        static const char* names[PHASE_COUNT] = {"lex", "parse", "optimize", "compile", "evaluate", "format", "output"};
+        out << "{\"expressions\": " << expressions << ", \"rows\": " << rows << ", \"operations\": " << operations
+            << ", \"bytes_written\": " << bytes_written << ", \"writes\": " << writes << ", \"flushes\": " << flushes
+            << ", \"phases\": {";
+        for(int p = 0; p < PHASE_COUNT; ++p) {
+            out << (p ? ", " : "") << '"' << names[p] << "\": {\"wall_ms\": " << wall_ns[p] / 1e6
+                << ", \"cpu_ms\": " << cpu_ns[p] / 1e6 << '}';
         }
+        out << "}}\n";
+    }
+};
+
+// CPU time used so far by the calling thread.
+std::uint64_t threadCpuNanoseconds() {
+#ifdef TTG_POSIX
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<std::uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+    return static_cast<std::uint64_t>(std::clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
 
-        Token(Type type, Precedence precedence, bool value, std::string lexeme) {
-            _type = type;
-            _precedence = precedence;
-            _value = value;
-            _lexeme = lexeme;
+// Adds the time between start() and stop() to a phase of stats, if stats is
+// not null. A timer can be started and stopped any number of times, it
+// starts on construction and stops on destruction unless told otherwise.
+class PhaseTimer {
+    public:
+        PhaseTimer(Stats* stats, Stats::Phase phase, bool running = true) : _stats(stats), _phase(phase) {
+            if(running) start();
         }
-        const Type type() const {return _type;}
-        const int precedence() const {return _precedence;}
-        const bool value() const {return _value;}
-        const std::string lexeme() const {return _lexeme;}
-        
-        const bool isOperator() const {
-            switch(_type) {
-                case NEGATION:
-                case CONJUNCTION:
-                case DISJUNCTION:
-                case IMPLICATION:
-                case BICONDITIONAL: 
-                    return true;
-                default: return false;
-            }
+        ~PhaseTimer() {stop();}
+
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+        void start() {
+            if(!_stats || _running) return;
+            _running = true;
+            _wall = std::chrono::steady_clock::now();
+            _cpu = threadCpuNanoseconds();
         }
 
-        // Will not do anything if the token does not represent propositional variable.
-        void setValue(bool value) {
-            if(_type == PROPOSITION)
-                _value = value;
+        void stop() {
+            if(!_stats || !_running) return;
+            _running = false;
+            _stats->wall_ns[_phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _wall).count();
+            _stats->cpu_ns[_phase] += threadCpuNanoseconds() - _cpu;
         }
+
     private:
-        Type _type;
-        Precedence _precedence;
-        bool _value;
-        std::string _lexeme;
+        Stats* _stats;
+        Stats::Phase _phase;
+        bool _running = false;
+        std::chrono::steady_clock::time_point _wall;
+        std::uint64_t _cpu = 0;
 };
 
-// inspired by https://craftinginterpreters.com/scanning.html
-class Lexer {
+// Passes everything written to it on to another stream buffer, counting the
+// bytes, writes and flushes. Installed under std::cout with --stats only, it
+// does no buffering of its own.
+class CountingBuffer : public std::streambuf {
     public:
-        Lexer(std::string source) {
-            _source = source;
-            scanTokens();
+        CountingBuffer(std::streambuf* target, Stats& stats) : _target(target), _stats(stats) {}
+
+    protected:
+        int_type overflow(int_type c) override {
+            if(traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            ++_stats.bytes_written;
+            ++_stats.writes;
+            return _target->sputc(traits_type::to_char_type(c));
         }
 
-        const std::vector<Token> getTokens() const {
-            return _tokens;
+        std::streamsize xsputn(const char* s, std::streamsize count) override {
+            _stats.bytes_written += count;
+            ++_stats.writes;
+            return _target->sputn(s, count);
         }
 
-        const std::map<std::string, Token> getPropositionTokens() const {
-            return _proposition_tokens;
+        int sync() override {
+            ++_stats.flushes;
+            return _target->pubsync();
         }
 
-        const void Print() const {
-            for(int i{}; i < _tokens.size(); ++i) {
-                std::cout << i + 1 << ". Type: " << _tokens[i].type() << ", Lexeme: " + _tokens[i].lexeme() << std::endl;
-            }
+    private:
+        std::streambuf* _target;
+        Stats& _stats;
+};
+
+// Settings taken from the command line.
+struct Options {
+    enum Mode {
+        TABLE = 0,  // Print every row.
+        COUNT,      // Only print how many rows are true.
+        FIRST,      // Only print the first row that is true.
+        TRUE_ROWS,  // Only print the rows that are true.
+        FALSE_ROWS, // Only print the rows that are false.
+        SAT,        // Only tell whether some row is true, and which.
+        VALID,      // Only tell whether all rows are true, or which is not.
+        DNF,        // Print a minimized sum of products.
+        CNF,        // Print a minimized product of sums.
+        BITS,       // Print the results as a packed bitset, see printBits().
+        BDD         // Answer questions about the expression from its BDD.
+    };
+    Mode mode = TABLE;
+    bool batch = false;                  // Read expressions without prompting, see runBatch().
+    bool gray = false;                   // Print the table in Gray code order, see formatGrayRows().
+    std::string columns;                 // Columns to print instead of the usual ones, see printColumns().
+    int split_count = 0;                 // Propositions to split on, see SplitFormula.
+    std::string equivalent_to;           // Formula to compare against in BDD mode.
+    bool jit = false;                    // Run formulas as native code, see CompiledFormula::enableNative().
+    std::shared_ptr<FormulaCache> cache; // Shared by every expression evaluated, if set.
+    std::string binary_file;             // Write the results here instead, see writeBinaryTable().
+    std::uint64_t shard_index = 0;       // Slice of the rows to go through, see shardRows().
+    std::uint64_t shard_count = 1;
+    unsigned thread_count = 1;           // Worker threads used to evaluate rows.
+    std::uint64_t chunk_rows = 1 << 16;  // Rows handed to a worker at a time.
+    std::uint64_t memory_limit = 0;      // Bytes of output held in flight at most, see boundedOptions().
+    std::shared_ptr<Stats> stats;        // Counters and timers for --stats, if set.
+};
+
+// The rows [first, end) of a table of rows rows that make up slice
+// options.shard_index of options.shard_count, all of them without --shard.
+// Slices are as equal as they can be while starting on a 64-row block
+// boundary, so each shard's results are whole words of the bitset.
+std::pair<std::uint64_t, std::uint64_t> shardRows(std::uint64_t rows, const Options& options) {
+    std::uint64_t blocks = (rows + 63) / 64;
+    // blocks * k / N, without overflowing for large tables.
+    auto boundary = [&](std::uint64_t k) {
+        std::uint64_t n = options.shard_count;
+        return std::min(rows, 64 * (blocks / n * k + blocks % n * k / n));
+    };
+    return {boundary(options.shard_index), boundary(options.shard_index + 1)};
+}
+
+// How the rows of a shard are cut into the chunks handed to the threads.
+// Chunks are cut at multiples of the chunk size counted from row 0, so they
+// start on a 64-row block boundary and line up the same in every shard.
+class ChunkPlan {
+    public:
+        ChunkPlan(std::uint64_t rows, const Options& options) {
+            std::tie(_first_row, _end_row) = shardRows(rows, options);
+            _chunk_rows = std::max<std::uint64_t>(64, (options.chunk_rows + 63) / 64 * 64);
+            _base = _first_row / _chunk_rows;
+            _count = _end_row > _first_row ? (_end_row + _chunk_rows - 1) / _chunk_rows - _base : 0;
         }
 
+        std::uint64_t count() const {return _count;}
+        std::uint64_t rows() const {return _end_row - _first_row;}
+
+        // First row of chunk c and how many rows it has, c counting from 0.
+        std::uint64_t first(std::uint64_t c) const {return std::max(_first_row, (_base + c) * _chunk_rows);}
+        std::uint64_t size(std::uint64_t c) const {return std::min(_end_row, (_base + c + 1) * _chunk_rows) - first(c);}
+
     private:
+        std::uint64_t _first_row{};
+        std::uint64_t _end_row{};
+        std::uint64_t _chunk_rows{};
+        std::uint64_t _base{};    // Index of the first chunk counted from row 0.
+        std::uint64_t _count{};
+};
+
+// options with chunks small enough that the chunks printRows() keeps in
+// flight, two per thread, hold at most options.memory_limit bytes of output
+// between them, given how many a row takes. Chunks stay a power of two rows,
+// so they still fall within the blocks of a SplitFormula, and do not go
+// below 64 rows.
+Options boundedOptions(const Options& options, double row_bytes) {
+    if(options.memory_limit == 0) return options;
+    Options bounded = options;
+    double in_flight = 2.0 * std::max(1u, options.thread_count);
+    double rows = static_cast<double>(options.memory_limit) / (in_flight * std::max(row_bytes, 0.125));
+    std::uint64_t chunk_rows = 64;
+    while(2.0 * chunk_rows <= rows && 2 * chunk_rows <= options.chunk_rows) chunk_rows *= 2;
+    bounded.chunk_rows = std::min(options.chunk_rows, chunk_rows);
+    return bounded;
+}
+
+// Just a container for True(T) or False(F) labels, 'F' is stored at index 0
+// and 'T' at index 1 for convenient use with a boolean.
+const char TV[] = {'F', 'T'};
 
-        void scanToken() {
-            switch(_source[_current_position]) {
-                // =========================================================
-                // Ignore Whitespace
-                case ' ':
-                    break;
-                // =========================================================
-                // Truth values
-                case '0':
-                case 'F':
-                    addToken(Token::Type::TRUTH_VALUE, false);
-                    break;
-                case '1':
-                case 'T':
-                    addToken(Token::Type::TRUTH_VALUE, true);
-                    break;
-                // =========================================================
-                // Parentheses
-                case '(':
-                    addToken(Token::Type::LPAREN, Token::Precedence::NA);
-                    break;
-                case ')':
-                    addToken(Token::Type::RPAREN, Token::Precedence::NA);
-                    break;
-                // =========================================================
-                // Single-char operators
-                case '^':
-                case '*':
-                    addToken(Token::Type::CONJUNCTION, Token::Precedence::L2);
-                    break;
-                case 'v':
-                case '+':
-                    addToken(Token::Type::DISJUNCTION, Token::Precedence::L3);
-                    break;
-                case '!':
-                case '~':
-                    addToken(Token::Type::NEGATION, Token::Precedence::L1);
-                    break;
-                // =========================================================
-                // Multi-char operators
-                case '-':
-                    if(matchNext('>')) addToken(Token::Type::IMPLICATION, Token::Precedence::L4);
-                    break;
-                case '<':
-                    if(matchNext('-') && matchNext('>')) addToken(Token::Type::BICONDITIONAL, Token::Precedence::L5);
-                    break;
-                // =========================================================
-                // Propositional Variables
-                default:
-                    addToken(Token::Type::PROPOSITION);
-                    _proposition_tokens.insert({getCurrentLexeme(), Token(Token::Type::PROPOSITION, Token::Precedence::NA, false, getCurrentLexeme())});
-                    break;
-                // =========================================================
+// Every row of a table has the same width, so rows are formatted by copying a
+// preformatted line and only patching in the truth values.
+class RowTemplate {
+    public:
+        // Each variable is followed by separator and gap goes between the last
+        // one and the result.
+        RowTemplate(int variables, char separator, const std::string& gap) {
+            _variables = variables;
+            for(int j = 0; j < variables; ++j) {
+                _text += 'F';
+                _text += separator;
             }
-            ++_current_position;
+            _text += gap;
+            _text += "F\n";
         }
 
-        void addToken(Token::Type type) {
-            _tokens.push_back(Token(type, Token::Precedence::NA, false, getCurrentLexeme()));
+        std::size_t size() const {return _text.size();}
+
+        // Writes a full row into dest, which must have room for size() chars.
+        void write(std::uint64_t row, bool result, char* dest) const {
+            std::memcpy(dest, _text.data(), _text.size());
+            patch(row, _variables, result, dest);
         }
 
-        void addToken(Token::Type type, Token::Precedence precedence) {
-            _tokens.push_back(Token(type, precedence, false, getCurrentLexeme()));
+        // Turns a copy of the previous row (row - 1) in dest into row. Only
+        // the low bits that carried when counting up need to change, which is
+        // 2 of them on average.
+        void writeNext(std::uint64_t row, bool result, char* dest) const {
+            std::memcpy(dest, dest - _text.size(), _text.size());
+            int changed = row ? CompiledFormula::countTrailingZeros(row) + 1 : _variables;
+            patch(row, std::min(changed, _variables), result, dest);
+        }
+
+        // Turns a copy of the previous row in dest into row, which differs
+        // from it only in row bit bit.
+        void writeFlip(std::uint64_t row, int bit, bool result, char* dest) const {
+            std::memcpy(dest, dest - _text.size(), _text.size());
+            dest[2 * (_variables - 1 - bit)] = TV[!((row >> bit) & 1)];
+            dest[_text.size() - 2] = TV[result];
+        }
+
+    private:
+        // Sets the last count variables and the result. The first variable
+        // sits in the most significant row bit, as everywhere else.
+        void patch(std::uint64_t row, int count, bool result, char* dest) const {
+            for(int j = 0; j < count; ++j) {
+                dest[2 * (_variables - 1 - j)] = TV[!((row >> j) & 1)];
+            }
+            dest[_text.size() - 2] = TV[result];
+        }
+
+        std::string _text;
+        int _variables;
+};
+
+// Evaluates and formats count rows of the table starting at first (a multiple
+// of 64) into out, which is reused between calls so its buffer gets allocated
+// only once. Formula is a CompiledFormula or a SplitFormula, here and below.
+template<class Formula>
+void formatRows(Formula& compiled, const RowTemplate& format, std::uint64_t first, std::uint64_t count, std::string& out,
+                Stats* stats = nullptr) {
+    PhaseTimer formatting(stats, Stats::FORMAT);
+    PhaseTimer evaluating(stats, Stats::EVALUATE, false);
+    out.resize(count * format.size());
+    char* dest = &out[0];
+    std::uint64_t results[64];
+    for(std::uint64_t i = first; i < first + count; ++i, dest += format.size()) {
+        // Rows are evaluated a few thousand at a time, by the widest kernel
+        // the processor supports, and then formatted one by one.
+        if((i - first) % (64 * 64) == 0) {
+            formatting.stop();
+            evaluating.start();
+            compiled.evalBlock(i, std::min<std::uint64_t>(64 * 64, first + count - i), results);
+            evaluating.stop();
+            formatting.start();
+        }
+        bool result = (results[(i - first) % (64 * 64) / 64] >> (i % 64)) & 1;
+        if(i == first) format.write(i, result, dest);
+        else format.writeNext(i, result, dest);
+    }
+}
+
+// Same as formatRows(), but only for the rows where the expression gives
+// value. The results are scanned a word at a time, jumping from one such row
+// to the next, so only the rows printed are formatted at all. Returns how
+// many there were.
+template<class Formula>
+std::uint64_t formatMatchingRows(Formula& compiled, const RowTemplate& format, bool value, std::uint64_t first, std::uint64_t count,
+                                 std::string& out, Stats* stats = nullptr) {
+    PhaseTimer formatting(stats, Stats::FORMAT, false);
+    out.clear();
+    std::uint64_t found = 0;
+    std::uint64_t results[64];
+    for(std::uint64_t done = 0; done < count; done += 64 * 64) {
+        std::uint64_t rows = std::min<std::uint64_t>(64 * 64, count - done);
+        {
+            PhaseTimer evaluating(stats, Stats::EVALUATE);
+            compiled.evalBlock(first + done, rows, results);
+        }
+        formatting.start();
+        for(std::uint64_t b = 0; b < (rows + 63) / 64; ++b) {
+            std::uint64_t hits = (value ? results[b] : ~results[b]) & CompiledFormula::blockMask(rows - 64 * b);
+            for(; hits; hits &= hits - 1) {
+                std::uint64_t row = first + done + 64 * b + CompiledFormula::countTrailingZeros(hits);
+                out.resize(out.size() + format.size());
+                format.write(row, value, &out[out.size() - format.size()]);
+                ++found;
+            }
         }
+        formatting.stop();
+    }
+    return found;
+}
 
-        void addToken(Token::Type type, bool value) {
-            _tokens.push_back(Token(type, Token::Precedence::NA, value, getCurrentLexeme()));
+// Same as formatRows(), for positions first to first + count of the Gray code
+// order. Only the start of a chunk is evaluated in full, every later row just
+// updates what depends on the proposition that changed. Evaluation and
+// formatting are interleaved row by row, so all of it counts as evaluation.
+void formatGrayRows(IncrementalFormula& formula, const RowTemplate& format, std::uint64_t first, std::uint64_t count, std::string& out,
+                    Stats* stats = nullptr) {
+    PhaseTimer evaluating(stats, Stats::EVALUATE);
+    out.resize(count * format.size());
+    char* dest = &out[0];
+    format.write(IncrementalFormula::grayRow(first), formula.reset(IncrementalFormula::grayRow(first)), dest);
+    for(std::uint64_t i = first + 1; i < first + count; ++i) {
+        dest += format.size();
+        int bit = IncrementalFormula::grayBit(i);
+        bool result = formula.flip(bit);
+        format.writeFlip(formula.row(), bit, result, dest);
+    }
+}
+
+// The columns printColumns() prints. The whole expression is worked out by
+// its optimized, compiled formula, as for the full table, and the other
+// columns by a ColumnFormula over the expression as parsed, which computes
+// only the nodes they need. Copy it for each thread, like the formulas.
+class ColumnTable {
+    public:
+        // columns as for ColumnFormula, result the compiled expression if
+        // the root is one of them.
+        ColumnTable(const Expression& parsed, const std::vector<std::uint32_t>& columns, std::optional<CompiledFormula> result)
+            : _others(parsed, othersOf(parsed, columns)), _result(std::move(result)), _columns(columns.size()),
+              _other_words(_others.columnCount()) {
+            auto root = std::find(columns.begin(), columns.end(), parsed.root());
+            _result_column = root == columns.end() || !_result ? columns.size() : root - columns.begin();
         }
 
-        void scanTokens() {
-            while(!endReached()) {
-                _start_position = _current_position;
-                scanToken();
+        std::uint64_t rowCount() const {return _others.rowCount();}
+
+        std::size_t columnCount() const {return _columns;}
+
+        // Same as in ColumnFormula.
+        void evalBlock(std::uint64_t firstRow, std::uint64_t* out) {
+            _others.evalBlock(firstRow, _other_words.data());
+            for(std::size_t c = 0, o = 0; c < _columns; ++c) {
+                if(c == _result_column) _result->evalBlock(firstRow, std::min<std::uint64_t>(64, rowCount() - firstRow), &out[c]);
+                else out[c] = _other_words[o++];
             }
         }
 
-        std::string getCurrentLexeme() {
-            std::string result = "";
-            for(int i{_start_position}; i <= _current_position; ++i) {result += _source[i];}
-            return result;
+        std::uint64_t operationCount() const {return _others.operationCount() + (_result ? _result->operationCount() : 0);}
+
+    private:
+        static std::vector<std::uint32_t> othersOf(const Expression& parsed, std::vector<std::uint32_t> columns) {
+            columns.erase(std::remove(columns.begin(), columns.end(), parsed.root()), columns.end());
+            return columns;
+        }
+
+        ColumnFormula _others;
+        std::optional<CompiledFormula> _result;
+        std::size_t _columns;
+        std::size_t _result_column;
+        std::vector<std::uint64_t> _other_words;
+};
+
+// Same as formatRows(), for the columns of a ColumnTable. line is an empty
+// row and positions[c] where column c's value goes in it.
+void formatColumns(ColumnTable& formula, const std::string& line, const std::vector<std::size_t>& positions,
+                   std::uint64_t first, std::uint64_t count, std::string& out, Stats* stats = nullptr) {
+    PhaseTimer formatting(stats, Stats::FORMAT);
+    PhaseTimer evaluating(stats, Stats::EVALUATE, false);
+    out.resize(count * line.size());
+    char* dest = &out[0];
+    std::vector<std::uint64_t> words(formula.columnCount());
+    for(std::uint64_t i = first; i < first + count; ++i, dest += line.size()) {
+        if(i % 64 == 0) {
+            formatting.stop();
+            evaluating.start();
+            formula.evalBlock(i, words.data());
+            evaluating.stop();
+            formatting.start();
+        }
+        std::memcpy(dest, line.data(), line.size());
+        for(std::size_t c = 0; c < positions.size(); ++c) dest[positions[c]] = TV[(words[c] >> (i % 64)) & 1];
+    }
+}
+
+// Prints every row of the table, calling format_rows(worker, first, count,
+// text) to format each chunk of it, where worker is a copy of evaluator. With
+// more than one thread the row space is split into chunks which the workers
+// claim in order; each chunk is formatted into its own buffer and the buffers
+// are written out in row order, so the output is the same as the single
+// threaded one. At most two chunks per worker are held in memory at once,
+// and when out is slow to take them the workers wait, so rows are never
+// produced faster than they are written. row_bytes is how much output a row
+// makes, for boundedOptions(). With --shard only the shard's rows are
+// printed.
+template<class Evaluator, class Format>
+void printRows(const Evaluator& evaluator, const Options& unbounded, std::ostream& out, double row_bytes, Format format_rows) {
+    Options options = boundedOptions(unbounded, row_bytes);
+    Stats* stats = options.stats.get();
+    ChunkPlan plan(evaluator.rowCount(), options);
+    std::uint64_t chunks = plan.count();
+    if(stats) stats->rows += plan.rows();
+
+    if(options.thread_count <= 1 || chunks <= 1) {
+        Evaluator worker = evaluator;
+        std::string text;
+        for(std::uint64_t c = 0; c < chunks; ++c) {
+            format_rows(worker, plan.first(c), plan.size(c), text);
+            PhaseTimer writing(stats, Stats::OUTPUT);
+            out.write(text.data(), text.size());
+        }
+        if(stats) stats->operations += worker.operationCount() - evaluator.operationCount();
+        return;
+    }
+
+    unsigned thread_count = static_cast<unsigned>(std::min<std::uint64_t>(options.thread_count, chunks));
+    std::uint64_t window = 2 * thread_count;      // Chunks allowed in flight.
+    std::vector<std::string> pieces(window);
+    std::vector<char> ready(window, false);
+    std::uint64_t next = 0;                       // Next chunk to be claimed.
+    std::uint64_t written = 0;                    // Chunks already printed.
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    auto work = [&]() {
+        Evaluator worker = evaluator;          // Each worker has its own operand storage.
+        std::unique_lock<std::mutex> lock(mutex);
+        while(next < chunks) {
+            std::uint64_t c = next++;
+            // Wait for the printer to free this chunk's slot.
+            changed.wait(lock, [&]{return c < written + window;});
+            std::string& text = pieces[c % window];
+            lock.unlock();
+            format_rows(worker, plan.first(c), plan.size(c), text);
+            lock.lock();
+            ready[c % window] = true;
+            changed.notify_all();
+        }
+        if(stats) stats->operations += worker.operationCount() - evaluator.operationCount();
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < thread_count; ++t) workers.emplace_back(work);
+
+    for(std::uint64_t c = 0; c < chunks; ++c) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]{return ready[c % window] != 0;});
+        lock.unlock();
+        {
+            PhaseTimer writing(stats, Stats::OUTPUT);
+            out.write(pieces[c % window].data(), pieces[c % window].size());
+        }
+        lock.lock();
+        ready[c % window] = false;
+        ++written;
+        changed.notify_all();
+    }
+    for(std::thread& t : workers) t.join();
+}
+
+// Calls work(worker, first_row, row_count) for every chunk of the table, on
+// options.thread_count threads, each with its own copy of compiled. Chunks
+// are claimed in row order. Once work returns true for a chunk, chunks after
+// it are no longer started, but all chunks before it still run to the end.
+// work adds the rows it went through to options.stats itself, how many that
+// is depends on the query. With --shard only the shard's rows are visited.
+template<class Formula, class Work>
+void runChunks(const Formula& compiled, const Options& options, Work work) {
+    Stats* stats = options.stats.get();
+    ChunkPlan plan(compiled.rowCount(), options);
+    std::uint64_t chunks = plan.count();
+    std::atomic<std::uint64_t> next{0};
+    std::atomic<std::uint64_t> stop{chunks};    // Lowest chunk that asked to stop.
+
+    auto run = [&]() {
+        Formula worker = compiled;
+        PhaseTimer evaluating(stats, Stats::EVALUATE);
+        for(std::uint64_t c = next++; c < stop; c = next++) {
+            if(work(worker, plan.first(c), plan.size(c))) {
+                std::uint64_t current = stop;
+                while(c < current && !stop.compare_exchange_weak(current, c)) {}
+            }
         }
+        if(stats) stats->operations += worker.operationCount() - compiled.operationCount();
+    };
 
-        bool matchNext(char c) {
-            ++_current_position;
-            if(endReached()) return false;
-            if(_source[_current_position] != c) return false;
-            return true;
+    unsigned thread_count = static_cast<unsigned>(std::min<std::uint64_t>(std::max(1u, options.thread_count), chunks));
+    std::vector<std::thread> workers;
+    for(unsigned t = 1; t < thread_count; ++t) workers.emplace_back(run);
+    run();
+    for(std::thread& t : workers) t.join();
+}
+
+template<class Formula>
+std::uint64_t countRows(const Formula& compiled, const Options& options) {
+    std::atomic<std::uint64_t> total{0};
+    runChunks(compiled, options, [&](Formula& worker, std::uint64_t first, std::uint64_t count) {
+        total += worker.countSatisfying(first, count);
+        if(options.stats) options.stats->rows += count;
+        return false;
+    });
+    return total;
+}
+
+// Lowest row for which the expression gives value, or rowCount() if none
+// does.
+template<class Formula>
+std::uint64_t findFirstRow(const Formula& compiled, const Options& options, bool value = true) {
+    std::atomic<std::uint64_t> best{compiled.rowCount()};
+    runChunks(compiled, options, [&](Formula& worker, std::uint64_t first, std::uint64_t count) {
+        std::uint64_t row = value ? worker.firstSatisfying(first, count) : worker.firstFalsifying(first, count);
+        if(options.stats) options.stats->rows += row == first + count ? count : row - first + 1;
+        if(row == first + count) return false;
+        std::uint64_t current = best;
+        while(row < current && !best.compare_exchange_weak(current, row)) {}
+        return true;
+    });
+    return best;
+}
+
+#ifdef TTG_POSIX
+// A file of a fixed size mapped into memory for writing, so results can be
+// stored straight into it without going through a buffer.
+class MappedFile {
+    public:
+        MappedFile(const std::string& path, std::uint64_t size) {
+            _size = size;
+            _fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(_fd < 0) return;
+            if(size == 0 || ftruncate(_fd, static_cast<off_t>(size)) != 0) return;
+            void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+            if(map != MAP_FAILED) _data = static_cast<char*>(map);
         }
 
-        const bool endReached() const {
-            return _current_position >= _source.size();
+        ~MappedFile() {
+            if(_data) munmap(_data, _size);
+            if(_fd >= 0) close(_fd);
         }
 
-        std::vector<Token> _tokens;
-        std::map<std::string, Token> _proposition_tokens;
-        std::string _source;
-        int _start_position{};
-        int _current_position{};
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool ok() const {return _data != nullptr;}
+        char* data() {return _data;}
+
+    private:
+        char* _data{};
+        std::uint64_t _size{};
+        int _fd{-1};
 };
+#endif
+
+// Evaluates count rows from first, which starts a 64-row block, into text
+// as the bytes of the bitset --binary writes.
+template<class Formula>
+void packBits(Formula& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+    std::uint64_t results[64];
+    text.resize((count + 7) / 8);
+    for(std::uint64_t done = 0; done < count; done += 64 * 64) {
+        std::uint64_t rows = std::min<std::uint64_t>(64 * 64, count - done);
+        worker.evalBlock(first + done, rows, results);
+        for(std::uint64_t b = 0; b < (rows + 7) / 8; ++b) {
+            text[done / 8 + b] = static_cast<char>((results[b / 8] >> (8 * (b % 8))) & 0xFF);
+        }
+    }
+}
+
+// Writes the result column of the table to path as a packed bitset.
+// The file starts with a header, all integers little endian:
+//   0   "TTGB"               magic
+//   4   u32                  format version, 1 for a whole table, 2 for a shard
+//   8   u32                  number of propositions
+//   12  u32                  length of the expression in bytes
+//   16  u64                  number of rows of the whole table
+//   24  u64                  offset of the bitset, a multiple of 64
+// and in version 2 only
+//   32  u64                  first row held, a multiple of 64
+//   40  u64                  number of rows held
+// then
+//   32 (48)  propositions    in table order, each as a u16 length and its bytes
+//            expression      the expression as entered
+// followed by zero padding up to the bitset. Bit (i % 8) of byte (i / 8)
+// holds the result of row first + i, rows numbered as in the text table, so
+// the first proposition is the most significant bit and row 0 is the all-True
+// row. A version 1 file holds every row, starting at row 0.
+// Regular files are mapped and filled in place. Pipes and devices cannot be
+// mapped, so the bitset is streamed to those through printRows() instead,
+// which waits for the reader and keeps only a few chunks in memory.
+// Returns an empty string on success, otherwise what went wrong.
+template<class Formula>
+std::string writeBinaryTable(const Formula& compiled, const std::string& expression,
+                             const std::string& path, const Options& options) {
+    std::string header = "TTGB";
+    auto put = [&header](std::uint64_t value, int bytes) {
+        for(int b = 0; b < bytes; ++b) header += static_cast<char>((value >> (8 * b)) & 0xFF);
+    };
+    // Only shards need the range of rows they hold.
+    bool sharded = options.shard_count > 1;
+    std::uint64_t first_row, end_row;
+    std::tie(first_row, end_row) = shardRows(compiled.rowCount(), options);
+    put(sharded ? 2 : 1, 4);
+    put(compiled.variableCount(), 4);
+    put(expression.size(), 4);
+    put(compiled.rowCount(), 8);
+    put(0, 8); // Offset, filled in below.
+    if(sharded) {
+        put(first_row, 8);
+        put(end_row - first_row, 8);
+    }
+    for(const std::string& name : compiled.propositionNames()) {
+        put(name.size(), 2);
+        header += name;
+    }
+    header += expression;
+    std::uint64_t offset = (header.size() + 63) / 64 * 64;
+    for(int b = 0; b < 8; ++b) header[24 + b] = static_cast<char>((offset >> (8 * b)) & 0xFF);
+
+    // The bitset is stored in whole words, the bits past the last row are 0.
+    std::uint64_t words = (end_row - first_row + 63) / 64;
+#ifdef TTG_POSIX
+    struct stat target;
+    bool mappable = ::stat(path.c_str(), &target) != 0 || S_ISREG(target.st_mode);
+#else
+    bool mappable = false;
+#endif
+    if(!mappable) {
+        std::ofstream stream(path, std::ios::binary);
+        header.resize(offset, '\0');
+        if(!stream || !stream.write(header.data(), header.size())) return "Cannot write " + path + "!";
+        printRows(compiled, options, stream, 0.125, [&](Formula& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+            packBits(worker, first, count, text);
+        });
+        std::string padding(8 * words - (end_row - first_row + 7) / 8, '\0');
+        if(!stream.write(padding.data(), padding.size()) || !stream.flush()) return "Cannot write " + path + "!";
+        return "";
+    }
+
+#ifdef TTG_POSIX
+    MappedFile file(path, offset + 8 * words);
+    if(!file.ok()) return "Cannot write " + path + "!";
+    std::memcpy(file.data(), header.data(), header.size());
+
+    char* bits = file.data() + offset;
+    runChunks(compiled, options, [&](Formula& worker, std::uint64_t first, std::uint64_t count) {
+        std::uint64_t results[64];
+        for(std::uint64_t done = 0; done < count; done += 64 * 64) {
+            std::uint64_t rows = std::min<std::uint64_t>(64 * 64, count - done);
+            worker.evalBlock(first + done, rows, results);
+            for(std::uint64_t b = 0; b < (rows + 63) / 64; ++b) {
+                for(int k = 0; k < 8; ++k) {
+                    bits[(first + done - first_row) / 8 + 8 * b + k] = static_cast<char>((results[b] >> (8 * k)) & 0xFF);
+                }
+            }
+        }
+        if(options.stats) options.stats->rows += count;
+        return false;
+    });
+#endif
+    return "";
+}
+
+// Prints the results of the rows as a line with their number and the number
+// of bytes that follow, then those bytes, the bitset laid out as --binary
+// writes it, then a newline. With --shard only the slice's rows. The bytes
+// are streamed like the text table, never held whole.
+template<class Formula>
+void printBits(const Formula& compiled, const Options& options, std::ostream& out) {
+    ChunkPlan shard(compiled.rowCount(), options);
+    out << shard.rows() << '\t' << (shard.rows() + 7) / 8 << '\n';
+    printRows(compiled, options, out, 0.125, [&](Formula& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+        PhaseTimer evaluating(options.stats.get(), Stats::EVALUATE);
+        packBits(worker, first, count, text);
+    });
+    out << '\n';
+}
+
+// Writes the rows of the table, or what options asks for instead, for the
+// already compiled expression.
+template<class Formula>
+void printResults(const Formula& compiled, const Expression& optimized, const std::string& expression,
+                  const RowTemplate& format, const Options& options, std::ostream& out) {
+    ChunkPlan shard(compiled.rowCount(), options);
+    if(!options.binary_file.empty()) {
+        std::string error = writeBinaryTable(compiled, expression, options.binary_file, options);
+        if(!error.empty()) out << (options.batch ? "error\t" : "") << error << '\n';
+        else if(options.batch) out << shard.rows() << '\t' << options.binary_file << '\n';
+        else out << "Wrote " << shard.rows() << " rows to " << options.binary_file << ".\n";
+    } else if(options.mode == Options::COUNT) {
+        std::uint64_t count = countRows(compiled, options);
+        if(options.batch) out << count << '\t' << shard.rows() << '\n';
+        else if(options.shard_count > 1) out << "True in " << count << " of the " << shard.rows() << " rows of shard " << options.shard_index << "/" << options.shard_count << ".\n";
+        else out << "True in " << count << " of " << compiled.rowCount() << " rows.\n";
+    } else if(options.mode == Options::BITS) {
+        printBits(compiled, options, out);
+    } else if(options.mode == Options::FIRST) {
+        std::uint64_t row = findFirstRow(compiled, options);
+        if(row == compiled.rowCount()) {
+            if(!options.batch) out << "No row is true.\n";
+        } else {
+            std::string text(format.size(), ' ');
+            format.write(row, true, &text[0]);
+            out << text;
+        }
+    } else if(options.mode == Options::TRUE_ROWS || options.mode == Options::FALSE_ROWS) {
+        bool value = options.mode == Options::TRUE_ROWS;
+        std::atomic<std::uint64_t> found{0};
+        printRows(compiled, options, out, format.size(),
+                  [&](Formula& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+                      found += formatMatchingRows(worker, format, value, first, count, text, options.stats.get());
+                  });
+        if(found == 0 && !options.batch) out << (value ? "No row is true.\n" : "No row is false.\n");
+    } else if(options.mode == Options::SAT || options.mode == Options::VALID) {
+        // Both stop at the first row that settles the question, a witness
+        // for --sat and a counter-example for --valid.
+        bool sat = options.mode == Options::SAT;
+        std::uint64_t row = findFirstRow(compiled, options, sat);
+        bool found = row != compiled.rowCount();
+        if(options.batch) out << (sat ? (found ? "satisfiable" : "unsatisfiable") : (found ? "invalid" : "valid")) << '\n';
+        else if(sat) out << (found ? "Satisfiable, first true row:\n" : "Unsatisfiable, no row is true.\n");
+        else out << (found ? "Not valid, first false row:\n" : "Valid, every row is true.\n");
+        if(found) {
+            std::string text(format.size(), ' ');
+            format.write(row, sat, &text[0]);
+            out << text;
+        }
+    } else {
+        // Evaluation, runs over all 2 ^ (number of propositions) rows in order
+        // to calculate every possible set of truth values in a given expression.
+        // Rows are generated and printed as they go, the table is never held.
+        if(options.gray) {
+            printRows(IncrementalFormula(optimized), options, out, format.size(),
+                      [&](IncrementalFormula& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+                          formatGrayRows(worker, format, first, count, text, options.stats.get());
+                      });
+        } else {
+            printRows(compiled, options, out, format.size(),
+                      [&](Formula& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+                          formatRows(worker, format, first, count, text, options.stats.get());
+                      });
+        }
+    }
+}
+
+// Compiles optimized as the options ask. Small tables are cheap to
+// minimize, and optimized is replaced by the result when that is the
+// smaller program.
+CompiledFormula compileFormula(Expression& optimized, const std::vector<std::string_view>& propositions, const Options& options) {
+    Stats* stats = options.stats.get();
+    PhaseTimer optimizing(stats, Stats::OPTIMIZE);
+    if(options.mode != Options::BDD) optimized = cheapestForm(optimized, propositions);
+    optimizing.stop();
+    PhaseTimer compiling(stats, Stats::COMPILE);
+    CompiledFormula compiled(optimized, propositions);
+    if(options.jit) compiled.enableNative();
+    return compiled;
+}
+
+// Result table of the whole expression, evaluated in chunks on
+// options.thread_count threads. Also with --shard, since the table is kept
+// in the cache.
+template<class Formula>
+std::shared_ptr<const std::vector<std::uint64_t>> tabulate(const Formula& compiled, const Options& options) {
+    auto bits = std::make_shared<std::vector<std::uint64_t>>((compiled.rowCount() + 63) / 64);
+    Options whole = options;
+    whole.shard_index = 0;
+    whole.shard_count = 1;
+    runChunks(compiled, whole, [&](Formula& worker, std::uint64_t first, std::uint64_t count) {
+        worker.evalBlock(first, count, bits->data() + first / 64);
+        return false;
+    });
+    return bits;
+}
+
+// The Shannon split of --split, compiled as the options ask.
+SplitFormula compileSplit(const Expression& optimized, const std::vector<std::string_view>& propositions, const Options& options) {
+    PhaseTimer compiling(options.stats.get(), Stats::COMPILE);
+    SplitFormula split(optimized, propositions, options.split_count);
+    if(options.jit) split.enableNative();
+    return split;
+}
+
+// Chunks are kept within one block of the split, so each cofactor is
+// compiled once and the blocks become the units of work for the threads.
+Options splitOptions(const SplitFormula& split, const Options& options) {
+    Options split_options = options;
+    split_options.chunk_rows = std::min(options.chunk_rows, split.blockRows());
+    return split_options;
+}
+
+// Answers from entry, the one options.cache has for key or null on a miss,
+// what it can, adding what had to be worked out. Result tables are only kept
+// for the queries that need every row anyway, and only if they fit in the
+// cache. compiled is the entry's formula on a hit. With --split, whatever is
+// not answered from a table goes through the split.
+void printCached(const std::string& key, std::shared_ptr<const FormulaCache::Entry> entry, const CompiledFormula& compiled,
+                 const Expression& optimized, const std::string& expression, const std::vector<std::string_view>& propositions,
+                 const RowTemplate& format, const Options& options, std::ostream& out) {
+    bool all_rows = options.mode == Options::TABLE || options.mode == Options::COUNT || options.mode == Options::TRUE_ROWS ||
+                    options.mode == Options::FALSE_ROWS || options.mode == Options::BITS || !options.binary_file.empty();
+    bool fits = compiled.rowCount() / 8 < options.cache->maxBytes();
+    if(!entry || (!entry->bits && all_rows && fits)) {
+        std::shared_ptr<const std::vector<std::uint64_t>> bits;
+        if(all_rows && fits && options.split_count > 0) {
+            SplitFormula split = compileSplit(optimized, propositions, options);
+            bits = tabulate(split, splitOptions(split, options));
+        } else if(all_rows && fits) {
+            bits = tabulate(compiled, options);
+        }
+        // The compiled program is kept either way, it may be native code.
+        entry = std::make_shared<const FormulaCache::Entry>(FormulaCache::Entry{compiled, bits});
+        options.cache->insert(key, entry);
+    }
+    if(entry->bits) {
+        printResults(ResultTable(entry->bits, propositions), optimized, expression, format, options, out);
+    } else if(options.split_count > 0) {
+        SplitFormula split = compileSplit(optimized, propositions, options);
+        printResults(split, optimized, expression, format, splitOptions(split, options), out);
+    } else {
+        printResults(compiled, optimized, expression, format, options, out);
+    }
+}
+
+// Prints a minimized sum of products, or product of sums, with the same
+// table as the expression, in the syntax the Lexer reads. The table is
+// worked out whole first, the minimizer takes it as a bitset. The text is
+// written from the cubes directly, a cover can have far more terms than
+// formatExpression() would want to recurse through.
+void printMinimized(const CompiledFormula& compiled, const std::vector<std::string_view>& propositions,
+                    const Options& options, std::ostream& out) {
+    Stats* stats = options.stats.get();
+    PhaseTimer evaluating(stats, Stats::EVALUATE);
+    std::shared_ptr<const std::vector<std::uint64_t>> bits = tabulate(compiled, options);
+    evaluating.stop();
+    PhaseTimer optimizing(stats, Stats::OPTIMIZE);
+    bool sum = options.mode == Options::DNF;
+    int variables = compiled.variableCount();
+    std::vector<Cube> cover = minimizeCover(*bits, variables, sum);
+    optimizing.stop();
 
-// I wish this was more elegant. Maybe regular expressions could work here?
-bool validateTokenString(const std::vector<Token>& tokens) {
-    bool flag = true;
-    for(int i{}; i < tokens.size(); ++i) {
-        switch(tokens[i].type()) {
-            case Token::TRUTH_VALUE:
-            case Token::PROPOSITION:
-                if(!(   tokens.size() == 1 ||
-                        (tokens[i + 1].isOperator() && !(tokens[i + 1].type() == Token::NEGATION)) || 
-                        tokens[i - 1].isOperator() || 
-                        tokens[i - 1].type() == Token::LPAREN)) flag = false;   
-                break;
-            case Token::NEGATION:
-                if(!(   tokens[i + 1].type() == Token::TRUTH_VALUE || 
-                        tokens[i + 1].type() == Token::PROPOSITION ||
-                        tokens[i + 1].type() == Token::LPAREN || 
-                        tokens[i + 1].type() == Token::NEGATION ||
-                        tokens[i - 1].type() == Token::LPAREN ||
-                        tokens[i - 1].isOperator() && !(tokens[i + 1].type() == Token::NEGATION))) flag = false;
-                break;
-            case Token::CONJUNCTION:
-            case Token::DISJUNCTION:
-            case Token::IMPLICATION:
-            case Token::BICONDITIONAL:
-                if(!(   tokens[i + 1].type() == Token::TRUTH_VALUE || 
-                        tokens[i + 1].type() == Token::PROPOSITION ||
-                        tokens[i + 1].type() == Token::LPAREN ||  
-                        tokens[i + 1].type() == Token::NEGATION ||
-                        tokens[i - 1].type() == Token::TRUTH_VALUE || 
-                        tokens[i - 1].type() == Token::PROPOSITION ||
-                        tokens[i - 1].type() == Token::RPAREN
-                        )) flag = false;
-                break;
-            default:break;
-        }
-    }
-    return flag;
+    PhaseTimer formatting(stats, Stats::FORMAT);
+    std::string text;
+    for(const Cube& cube : cover) {
+        if(!text.empty()) text += sum ? " v " : " ^ ";
+        std::string term;
+        int literals = 0;
+        for(int slot = 0; slot < variables; ++slot) {
+            std::uint64_t bit = std::uint64_t{1} << (variables - 1 - slot);
+            if(!(cube.care & bit)) continue;
+            if(literals++) term += sum ? " ^ " : " v ";
+            // A set row bit means False, see productOfSums() for the clauses.
+            if(((cube.value & bit) != 0) == sum) term += '~';
+            term += propositions[slot];
+        }
+        if(literals == 0) term = sum ? "T" : "F";
+        text += !sum && literals > 1 ? "(" + term + ")" : term;
+    }
+    if(cover.empty()) text = sum ? "F" : "T";
+    formatting.stop();
+    if(options.batch) out << text << '\n';
+    else out << (sum ? "DNF: " : "CNF: ") << text << " (" << cover.size() << (sum ? " terms)\n" : " clauses)\n");
 }
 
-// Shunting yard algorithm is used here.
-std::vector<Token> toPostFix(const std::vector<Token>& tokens) {
-    std::stack<Token> operators;
-    std::vector<Token> output;
+// Numbers the distinct subexpressions of a parsed expression, so that two
+// nodes get the same number exactly when they are written the same way.
+// Built children first, in one pass over the nodes.
+class SubexpressionNumbers {
+    public:
+        explicit SubexpressionNumbers(const Expression& parsed) {
+            for(const Expression::Node& node : parsed.nodes()) _numbers.push_back(add(node, _numbers));
+        }
+
+        std::uint32_t operator[](std::uint32_t node) const {return _numbers[node];}
+
+        // The number of a subexpression written as text, with the names of
+        // propositions, or -1 if no subexpression is written that way.
+        // Whitespace and redundant parentheses do not matter.
+        std::int64_t find(const std::string& text, const std::vector<std::string_view>& propositions) const {
+            Lexer lexer(text);
+            Parser parser;
+            if(lexer.getTokens().empty() || !parser.parse(lexer.getTokens())) return -1;
+            std::vector<std::uint32_t> slots;
+            for(std::string_view name : lexer.getPropositions()) {
+                auto found = std::find(propositions.begin(), propositions.end(), name);
+                if(found == propositions.end()) return -1;
+                slots.push_back(static_cast<std::uint32_t>(found - propositions.begin()));
+            }
+            std::vector<std::uint32_t> numbers;
+            for(Expression::Node node : parser.expression().nodes()) {
+                if(node.kind == Expression::VARIABLE) node.left = slots[node.left];
+                auto found = _index.find(key(node, numbers));
+                if(found == _index.end()) return -1;
+                numbers.push_back(found->second);
+            }
+            return numbers.back();
+        }
+
+    private:
+        typedef std::tuple<int, std::uint32_t, std::uint32_t> Key;
+
+        // Operands are named by their numbers, propositions by their slots.
+        static Key key(const Expression::Node& node, const std::vector<std::uint32_t>& numbers) {
+            switch(node.kind) {
+                case Expression::FALSE_CONSTANT:
+                case Expression::TRUE_CONSTANT: return Key(node.kind, 0, 0);
+                case Expression::VARIABLE:      return Key(node.kind, node.left, 0);
+                case Expression::NOT:           return Key(node.kind, numbers[node.left], 0);
+                default:                        return Key(node.kind, numbers[node.left], numbers[node.right]);
+            }
+        }
+
+        std::uint32_t add(const Expression::Node& node, const std::vector<std::uint32_t>& numbers) {
+            return _index.emplace(key(node, numbers), static_cast<std::uint32_t>(_index.size())).first->second;
+        }
+
+        std::vector<std::uint32_t> _numbers;
+        std::map<Key, std::uint32_t> _index;
+};
 
-    for(const Token& t : tokens) {
-        if(t.isOperator()) {
-            while(!operators.empty() && t.precedence() > operators.top().precedence()) {
-                output.push_back(operators.top());
-                operators.pop();
+// Prints the table with only the columns options.columns asks for, computed
+// from the expression as parsed: "result" is just the result; "all" is every
+// proposition, then every distinct subexpression in the order they are
+// evaluated, ending with the whole expression; anything else is a comma
+// separated list naming propositions, subexpressions as they would be
+// written in the expression (spaces and redundant parentheses do not
+// matter) and "result". Only the headers of the chosen columns are written
+// out, so picking a few columns of a long expression costs less than the
+// whole table. Returns an empty string on success, otherwise what went
+// wrong.
+std::string printColumns(const Expression& parsed, const std::string& expression,
+                         const std::vector<std::string_view>& propositions, const Options& options, std::ostream& out) {
+    const std::vector<Expression::Node>& nodes = parsed.nodes();
+    std::uint32_t root = parsed.root();
+    std::vector<std::uint32_t> columns;
+    std::vector<std::string> headers;
+    if(options.columns == "result") {
+        columns.push_back(root);
+        headers.push_back(expression);
+    } else {
+        // A subexpression written more than once gets one column, the whole
+        // expression is headed the way it was entered.
+        SubexpressionNumbers numbers(parsed);
+        std::vector<char> taken(nodes.size(), 0);
+        auto add = [&](std::uint32_t node) {
+            if(taken[numbers[node]]) return;
+            taken[numbers[node]] = 1;
+            columns.push_back(node);
+            headers.push_back(node == root ? expression : formatExpression(parsed, node, propositions));
+        };
+        if(options.columns == "all") {
+            std::vector<std::uint32_t> slot_nodes(propositions.size(), root);
+            for(std::uint32_t i = nodes.size(); i-- > 0;) {
+                if(nodes[i].kind == Expression::VARIABLE) slot_nodes[nodes[i].left] = i;
             }
-            operators.push(t);
-        } else if(t.type() == Token::LPAREN) {
-            operators.push(t);
-        } else if(t.type() == Token::RPAREN) {
-            while(operators.top().type() != Token::LPAREN) {
-                output.push_back(operators.top());
-                operators.pop();
+            for(std::uint32_t node : slot_nodes) add(node);
+            for(std::uint32_t i = 0; i < root; ++i) {
+                if(nodes[i].kind >= Expression::NOT) add(i);
             }
-            operators.pop();
+            add(root);
         } else {
-            output.push_back(t);
+            // The node first numbered each way.
+            std::vector<std::uint32_t> first(nodes.size(), root);
+            for(std::uint32_t i = nodes.size(); i-- > 0;) first[numbers[i]] = i;
+            std::stringstream list(options.columns);
+            std::string item;
+            while(getline(list, item, ',')) {
+                if(item.find_first_not_of(" \t") == std::string::npos) continue;
+                std::string wanted = item;
+                wanted.erase(std::remove(wanted.begin(), wanted.end(), ' '), wanted.end());
+                std::int64_t number = wanted == "result" ? numbers[root] : numbers.find(item, propositions);
+                if(number < 0) return "No column " + item + " in the expression!";
+                add(first[number]);
+            }
+            if(columns.empty()) return "No columns selected!";
         }
     }
-    while(!operators.empty()) {
-        output.push_back(operators.top());
-        operators.pop();
+
+    // Each value sits under the middle of its header, in batch mode the
+    // headers and values are just tab separated.
+    std::string separator = options.batch ? "\t" : "  ";
+    std::string header;
+    std::string line;
+    std::vector<std::size_t> positions;
+    for(std::size_t c = 0; c < headers.size(); ++c) {
+        if(c) {
+            header += separator;
+            line += separator;
+        }
+        std::size_t width = options.batch ? 1 : headers[c].size();
+        positions.push_back(line.size() + (width - 1) / 2);
+        header += headers[c];
+        line += std::string(width, ' ');
+    }
+    line.resize(positions.back() + 1);
+    line += '\n';
+    out << header << (options.batch ? "\n" : "\n\n");
+
+    std::optional<CompiledFormula> result;
+    if(std::find(columns.begin(), columns.end(), root) != columns.end()) {
+        PhaseTimer optimizing(options.stats.get(), Stats::OPTIMIZE);
+        Expression optimized = optimize(parsed);
+        optimizing.stop();
+        result = compileFormula(optimized, propositions, options);
     }
-    return output;
+    PhaseTimer compiling(options.stats.get(), Stats::COMPILE);
+    ColumnTable formula(parsed, columns, std::move(result));
+    compiling.stop();
+    printRows(formula, options, out, line.size(), [&](ColumnTable& worker, std::uint64_t first, std::uint64_t count, std::string& text) {
+        formatColumns(worker, line, positions, first, count, text, options.stats.get());
+    });
+    return "";
 }
 
-void evaluate(std::string expression) {
+// Answers the questions BDD mode is for from the expression's diagram, never
+// going through the rows: whether it is a tautology or a contradiction, in
+// how many rows it is true, and, if options.equivalent_to is set, whether it
+// is equivalent to that formula.
+void printDecisions(const Expression& parsed, const std::string& expression, int variables, const Options& options, std::ostream& out) {
+    BDD bdd(variables);
+    BDD::Ref root = bdd.build(parsed);
+    BigUnsigned rows(1);
+    rows <<= variables;
+    std::string models = bdd.countModels(root).toString();
+    if(options.batch) {
+        out << (bdd.isTautology(root) ? "tautology" : bdd.isContradiction(root) ? "contradiction" : "satisfiable")
+            << '\t' << models << '\t' << rows.toString() << '\n';
+    } else {
+        out << (bdd.isTautology(root) ? "Tautology" : bdd.isContradiction(root) ? "Contradiction" : "Satisfiable")
+            << ", true in " << models << " of " << rows.toString() << " rows (" << bdd.size(root) << " BDD nodes).\n";
+    }
+    if(options.equivalent_to.empty()) return;
+
+    // Both formulas need their propositions in one set of slots, which lexing
+    // them as one biconditional gives. They are equivalent exactly when that
+    // is a tautology. Both halves were already checked to be valid.
+    std::string both = "(" + expression + ")<->(" + options.equivalent_to + ")";
+    Lexer lexer(both);
+    Parser parser;
+    parser.parse(lexer.getTokens());
+    BDD combined(static_cast<int>(lexer.getPropositions().size()));
+    bool equivalent = combined.isTautology(combined.build(parser.expression()));
+    if(options.batch) out << (equivalent ? "equivalent" : "not equivalent") << '\t' << options.equivalent_to << '\n';
+    else out << (equivalent ? "Equivalent to " : "Not equivalent to ") << options.equivalent_to << ".\n";
+}
+
+// Lexes, validates and evaluates an expression, writing the result to out.
+// Batch output is meant to be read by other programs: tab separated fields, a
+// header line naming the propositions followed by the expression, the data
+// lines, and a blank line to end the record.
+void evaluate(std::string expression, const Options& options, std::ostream& out) {
     // No need to do anything if the expression is empty.
     if(expression.empty()) return;
     
-    // Lexer lexes expression upon construction.
-    Lexer lexer(expression);
+    // Each thread keeps one Lexer around, so lexing reuses its token storage
+    // instead of allocating for every expression.
+    Stats* stats = options.stats.get();
+    thread_local Lexer lexer;
+    PhaseTimer lexing(stats, Stats::LEX);
+    lexer.scan(expression);
+    lexing.stop();
     
     // Tracks all expression tokens, regardless of type.
-    std::vector<Token> tokens = lexer.getTokens();
+    const std::vector<Token>& tokens = lexer.getTokens();
 
-    // Messy validation, unsure if it covers all cases, to be improved in the
-    // future.
-    if(!validateTokenString(tokens)) {
-        std::cout << "Invalid expression!\n";
+    // An expression of only whitespace has nothing to evaluate either.
+    if(tokens.empty()) return;
+
+    // Reports an error, in batch mode as a record of its own.
+    auto fail = [&](const std::string& message) {
+        if(options.batch) out << expression << "\nerror\t" << message << "\n\n";
+        else out << message << '\n';
+    };
+
+    // Validation and parsing happen in the same pass, which also tells where
+    // an invalid expression goes wrong.
+    thread_local Parser parser;
+    PhaseTimer parsing(stats, Stats::PARSE);
+    bool parsed = parser.parse(tokens);
+    parsing.stop();
+    if(!parsed) {
+        fail(std::string("Invalid expression! ") + parser.errorMessage() + " at column " + std::to_string(parser.errorColumn()) + ".");
         return;
     }
 
-    // Tracks propositional variables so we can set each appearance of the same 
-    // variable with its respective value.
-    std::map<std::string, Token> propositions = lexer.getPropositionTokens();
-    
-    std::stack<bool> operands; // Stores operands during post-fix evaluation.
-    
-    // Just a container for True(T) or False(F) labels, 'F' is stored at index 0
-    // and 'T' at index 1 for convenient use with a boolean.
-    char TV[] = {'F', 'T'};
-
-    // Solves a binary expression using the operands stack.
-    auto solveBinary = [&operands](bool(*func)(bool left, bool right)) {
-        bool right = operands.top();
-        operands.pop();
-        bool left = operands.top();
-        operands.pop();
-        return func(left, right);
+    // Tracks propositional variables, each one is given a slot in the compiled
+    // program based on its position in this sorted list.
+    const std::vector<std::string_view>& propositions = lexer.getPropositions();
+
+    // Enumeration needs a 64 bit row number for every row, the BDD does not
+    // number rows at all. Checked before anything is optimized or compiled
+    // for an expression that is turned away anyway.
+    if(options.mode != Options::BDD && propositions.size() > CompiledFormula::MAX_VARIABLES) {
+        fail("Too many propositions, at most " + std::to_string(CompiledFormula::MAX_VARIABLES) + " are supported!");
+        return;
+    }
+
+    bool minimizing = (options.mode == Options::DNF || options.mode == Options::CNF) && options.binary_file.empty();
+    if(minimizing && propositions.size() > MAX_MINIMIZE_VARIABLES) {
+        fail("Too many propositions to minimize, at most " + std::to_string(MAX_MINIMIZE_VARIABLES) + " are supported!");
+        return;
+    }
+
+    if(stats) ++stats->expressions;
+
+    // Picking columns only changes how the full table is printed, and
+    // works on the expression as parsed, it is not optimized or compiled.
+    if(!options.columns.empty() && options.mode == Options::TABLE && options.binary_file.empty()) {
+        std::string error = printColumns(parser.expression(), expression, propositions, options, out);
+        if(!error.empty()) fail(error);
+        else out << '\n';
+        return;
+    }
+
+    // Optimizing and lowering to bytecode only has to happen once per
+    // expression.
+    PhaseTimer optimizing(stats, Stats::OPTIMIZE);
+    Expression optimized = optimize(parser.expression());
+    optimizing.stop();
+
+    // A formula found in the cache is already minimized and compiled, the
+    // lookup comes before either.
+    bool caching = options.cache && !options.gray && options.mode != Options::BDD && !minimizing;
+    std::string key;
+    std::shared_ptr<const FormulaCache::Entry> cached;
+    if(caching) {
+        key = FormulaCache::canonicalForm(optimized);
+        cached = options.cache->find(key);
+    }
+    CompiledFormula compiled = cached ? cached->formula : compileFormula(optimized, propositions, options);
+    if(cached) compiled.renamePropositions(propositions);
+
+    // Printing table headers.
+    char separator = options.batch ? '\t' : ' ';
+    for(std::string_view name : propositions) {
+        out << name << separator;
+    }
+    if(options.batch) out << expression << '\n';
+    else out << '\t' << expression << (options.gray && options.mode == Options::TABLE ? "\t(Gray code order)" : "") << "\n\n";
+
+    // The result sits roughly under the middle of the expression, except in
+    // batch mode where it is just the last field.
+    std::string gap = options.batch ? "" : "\t" + std::string(std::max<std::size_t>(1, (expression.size() + 1)/2) - 1, ' ');
+    RowTemplate format(compiled.variableCount(), separator, gap);
+    if(options.mode == Options::BDD) {
+        PhaseTimer evaluating(stats, Stats::EVALUATE);
+        printDecisions(parser.expression(), expression, static_cast<int>(propositions.size()), options, out);
+    } else if(minimizing) {
+        printMinimized(compiled, propositions, options, out);
+    } else if(caching) {
+        printCached(key, cached, compiled, optimized, expression, propositions, format, options, out);
+    } else if(options.split_count > 0 && !options.gray) {
+        SplitFormula split = compileSplit(optimized, propositions, options);
+        printResults(split, optimized, expression, format, splitOptions(split, options), out);
+    } else {
+        printResults(compiled, optimized, expression, format, options, out);
+    }
+    out << '\n';
+} 
+
+// What one expression of a batch has printed and is waiting to be written,
+// in pieces, until the records before it are out.
+struct PendingRecord {
+    std::deque<std::string> parts;
+    std::uint64_t bytes = 0;
+    bool done = false;       // Everything has been printed.
+};
+
+// Stream buffer a batch worker prints one record through. Every 64 KiB it
+// hands what it has to the record's queue, waiting while the queue holds
+// limit bytes or more, so a record that is not next in line holds little
+// more than that however big its table is, and a slow reader of the output
+// holds the workers back instead of letting output pile up.
+class RecordBuffer : public std::streambuf {
+    public:
+        RecordBuffer(PendingRecord& record, std::uint64_t limit, std::mutex& mutex, std::condition_variable& changed)
+            : _record(record), _limit(limit), _mutex(mutex), _changed(changed) {
+            setp(_buffer, _buffer + sizeof(_buffer));
+        }
+
+        // Hands over the rest and marks the record as complete.
+        void finish() {
+            sync();
+            std::lock_guard<std::mutex> lock(_mutex);
+            _record.done = true;
+            _changed.notify_all();
+        }
+
+    protected:
+        int_type overflow(int_type c) override {
+            sync();
+            if(!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            if(pptr() == pbase()) return 0;
+            std::string part(pbase(), pptr());
+            setp(_buffer, _buffer + sizeof(_buffer));
+            std::unique_lock<std::mutex> lock(_mutex);
+            _changed.wait(lock, [&]{return _record.bytes < _limit;});
+            _record.bytes += part.size();
+            _record.parts.push_back(std::move(part));
+            _changed.notify_all();
+            return 0;
+        }
+
+    private:
+        PendingRecord& _record;
+        std::uint64_t _limit;
+        std::mutex& _mutex;
+        std::condition_variable& _changed;
+        char _buffer[1 << 16];
+};
+
+// Evaluates one expression per line of in without prompting, until the end
+// of the input. Up to options.thread_count expressions are evaluated at once,
+// each on a single thread, and their output is written in input order. The
+// output waiting to be written is bounded: each record in flight queues at
+// most its share of --max-memory, 1 MiB without.
+void runBatch(std::istream& in, const Options& options) {
+    Options single = options;
+    single.thread_count = 1;
+    // Every expression gets its own binary file, named after its line number.
+    auto evaluateLine = [&single](const std::string& line, std::uint64_t index, std::ostream& out) {
+        Options line_options = single;
+        if(!line_options.binary_file.empty()) line_options.binary_file += "." + std::to_string(index + 1);
+        evaluate(line, line_options, out);
     };
-    
-    // Solves a unary expression using the operands stack, 
-    // for now only used for the right side of a NOT operation.
-    auto solveUnary = [&operands](bool(*func)(bool right)) {
-        bool right = operands.top();
-        operands.pop();
-        return func(right);
+    unsigned thread_count = std::max(1u, options.thread_count);
+    if(thread_count == 1) {
+        std::string line;
+        for(std::uint64_t index = 0; getline(in, line); ++index) evaluateLine(line, index, std::cout);
+        return;
+    }
+
+    // Reading from std::cin flushes std::cout, which it is tied to. Workers
+    // read while the printer writes, so that would have two threads in
+    // std::cout at once.
+    std::ostream* tied = in.tie(nullptr);
+
+    std::uint64_t window = 4 * thread_count;     // Expressions allowed in flight.
+    std::uint64_t limit = options.memory_limit ? std::max<std::uint64_t>(1, options.memory_limit / window) : 1 << 20;
+    std::vector<PendingRecord> records(window);
+    std::uint64_t read = 0;                      // Lines taken from in.
+    std::uint64_t written = 0;                   // Results already printed.
+    bool finished = false;                       // in has been exhausted.
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    auto work = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::string line;
+        while(true) {
+            // Wait for the printer to free the next slot before reading on.
+            changed.wait(lock, [&]{return finished || read < written + window;});
+            if(finished || !getline(in, line)) {
+                finished = true;
+                changed.notify_all();
+                return;
+            }
+            std::uint64_t index = read++;
+            lock.unlock();
+            RecordBuffer buffer(records[index % window], limit, mutex, changed);
+            std::ostream text(&buffer);
+            evaluateLine(line, index, text);
+            buffer.finish();
+            lock.lock();
+        }
     };
 
-    // Printing table headers.
-    for(auto const& x : propositions) {
-        std::cout << x.first << ' ';
-    }
-    std::cout << '\t' << expression << std::endl << std::endl;
-
-    // Evaluation loop, runs 2 ^ (number of propositions) times in order to 
-    // calculate every possible set of truth values in a given expression.
-    for(int i{}; i < (1 << propositions.size()); ++i) {
-        // This next loop takes every propositional variable if any, and gives
-        // it a truth value.
-        int j = propositions.size() - 1;
-        for(auto & x : propositions) {
-            x.second.setValue(!(1 == ((i >> j--) & 1)));
-            std::cout << TV[x.second.value()] << ' ';
-        }
-        // This next loop evaluates a post-fix expression using another stack.
-        for(const Token& t : toPostFix(tokens)) {
-            switch(t.type()) {
-                case Token::TRUTH_VALUE:
-                    operands.push(t.value()); 
-                    break;
-                case Token::PROPOSITION:
-                    operands.push(propositions[t.lexeme()].value()); 
-                    break;
-                case Token::NEGATION:
-                    operands.push(solveUnary([](bool right){return !right;}));
-                    break;
-                case Token::CONJUNCTION:
-                    operands.push(solveBinary([](bool left, bool right){return left && right;}));
-                    break;
-                case Token::DISJUNCTION:
-                    operands.push(solveBinary([](bool left, bool right){return left || right;}));
-                    break;
-                case Token::IMPLICATION:
-                    operands.push(solveBinary([](bool left, bool right){return left <= right;}));
-                    break;
-                case Token::BICONDITIONAL:
-                    operands.push(solveBinary([](bool left, bool right){return left == right;}));
-                    break;
-                default:break;
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < thread_count; ++t) workers.emplace_back(work);
+
+    // Only this thread writes, taking the next record's pieces as they come.
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        PendingRecord& record = records[written % window];
+        changed.wait(lock, [&]{return !record.parts.empty() || record.done || (finished && written == read);});
+        if(!record.parts.empty()) {
+            std::string part = std::move(record.parts.front());
+            record.parts.pop_front();
+            record.bytes -= part.size();
+            changed.notify_all();
+            lock.unlock();
+            std::cout.write(part.data(), part.size());
+            lock.lock();
+        } else if(record.done) {
+            record.done = false;
+            ++written;
+            changed.notify_all();
+        } else {
+            break;
+        }
+    }
+    lock.unlock();
+    for(std::thread& t : workers) t.join();
+    in.tie(tied);
+}
+
+// Strips the options a request line starts with, "--count p ^ q" say, off
+// line and into options. Only those choosing what to print are taken.
+// Returns an empty string on success, otherwise what went wrong.
+std::string takeRequestOptions(std::string& line, Options& options) {
+    static const std::map<std::string, Options::Mode> modes = {
+        {"--table", Options::TABLE}, {"--count", Options::COUNT}, {"--first", Options::FIRST},
+        {"--only-true", Options::TRUE_ROWS}, {"--only-false", Options::FALSE_ROWS}, {"--sat", Options::SAT},
+        {"--valid", Options::VALID}, {"--dnf", Options::DNF}, {"--cnf", Options::CNF},
+        {"--bits", Options::BITS}, {"--bdd", Options::BDD}
+    };
+    std::size_t start = line.find_first_not_of(" \t");
+    while(start != std::string::npos && line.compare(start, 2, "--") == 0) {
+        std::size_t end = line.find_first_of(" \t", start);
+        std::string word = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        auto mode = modes.find(word);
+        if(mode == modes.end()) return "Unknown request option " + word + "!";
+        options.mode = mode->second;
+        start = end == std::string::npos ? end : line.find_first_not_of(" \t", end);
+    }
+    line.erase(0, start == std::string::npos ? line.size() : start);
+    return "";
+}
+
+#ifdef TTG_POSIX
+// Reads and writes a connected socket, for std::iostream.
+class SocketBuffer : public std::streambuf {
+    public:
+        explicit SocketBuffer(int fd) : _fd(fd) {
+            setg(_input, _input, _input);
+            setp(_output, _output + sizeof(_output));
+        }
+
+    protected:
+        int_type underflow() override {
+            ssize_t got;
+            do {
+                got = ::read(_fd, _input, sizeof(_input));
+            } while(got < 0 && errno == EINTR);
+            if(got <= 0) return traits_type::eof();
+            setg(_input, _input, _input + got);
+            return traits_type::to_int_type(_input[0]);
+        }
+
+        int_type overflow(int_type c) override {
+            if(sync() != 0) return traits_type::eof();
+            if(!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            for(char* p = pbase(); p < pptr();) {
+                ssize_t sent = ::write(_fd, p, static_cast<std::size_t>(pptr() - p));
+                if(sent < 0 && errno == EINTR) continue;
+                if(sent <= 0) return -1;
+                p += sent;
+            }
+            setp(_output, _output + sizeof(_output));
+            return 0;
+        }
+
+    private:
+        int _fd;
+        char _input[1 << 16];
+        char _output[1 << 16];
+};
+
+// Path of the socket, removed again when the server is stopped.
+static char socket_path[sizeof(sockaddr_un::sun_path)];
+
+extern "C" void stopServer(int) {
+    ::unlink(socket_path);
+    ::_exit(0);
+}
+
+// Answers one client until it hangs up or sends "quit". Every line is a
+// request, evaluated and answered as --batch would, so every answer is one
+// record ending in a blank line (empty lines get none). Answers go out once
+// there are no more requests waiting to be read, so a client may send many
+// at once.
+void serveConnection(int fd, const Options& options) {
+    SocketBuffer buffer(fd);
+    std::iostream stream(&buffer);
+    std::string line;
+    while(getline(stream, line) && line != "quit") {
+        Options request = options;
+        std::string error = takeRequestOptions(line, request);
+        if(!error.empty()) stream << line << "\nerror\t" << error << "\n\n";
+        else evaluate(line, request, stream);
+        if(buffer.in_avail() == 0) stream.flush();
+    }
+    stream.flush();
+}
+
+// Serves requests on a Unix socket at path until the process is stopped.
+// options.thread_count workers are started once and take connections as
+// they come, one each at a time, so the cost of starting a process and of
+// setting up each thread's Lexer and Parser is paid once, not per request.
+// They all share one FormulaCache, 64 MiB unless --cache says otherwise,
+// so formulas asked for again are neither compiled nor evaluated again.
+int runServer(const std::string& path, const Options& options) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << path << " is too long!\n";
+        return 1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    std::strcpy(socket_path, path.c_str());
+
+    // A socket left behind by an earlier server is replaced, anything else
+    // at path is not.
+    struct stat existing;
+    if(::lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) ::unlink(path.c_str());
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+       ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << '\n';
+        if(listener >= 0) ::close(listener);
+        return 1;
+    }
+    // A client hanging up early must not take the server with it.
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+
+    Options shared = options;
+    shared.batch = true;
+    shared.thread_count = 1;
+    if(!shared.cache) shared.cache = std::make_shared<FormulaCache>(std::size_t{64} << 20);
+
+    auto work = [&]() {
+        while(true) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if(fd < 0) {
+                if(errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+            serveConnection(fd, shared);
+            ::close(fd);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned t = 1; t < std::max(1u, options.thread_count); ++t) workers.emplace_back(work);
+    work();
+    for(std::thread& t : workers) t.join();
+    std::cerr << "Cannot accept connections on " << path << ": " << std::strerror(errno) << '\n';
+    ::close(listener);
+    ::unlink(path.c_str());
+    return 1;
+}
+#endif
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--batch [FILE]] [--binary FILE | --count | --first | --only-true | --only-false | --sat | --valid | --dnf | --cnf | --bits | --bdd | --equiv FORMULA | --gray] [--columns WHICH] [--split K] [--jit] [--cache MB] [--shard K/N] [--threads N] [--chunk-size ROWS] [--max-memory MB] [--stats] [--serve PATH]\n"
+              << "  --batch [FILE]      evaluate one expression per line of FILE (default stdin),\n"
+              << "                      without prompts and with tab separated output.\n"
+              << "  --binary FILE       write the results to FILE as a packed bitset instead of\n"
+              << "                      printing the table (in batch mode FILE.<line number>).\n"
+              << "  --count             only print how many rows are true.\n"
+              << "  --first             only print the first row that is true.\n"
+              << "  --only-true         only print the rows that are true.\n"
+              << "  --only-false        only print the rows that are false.\n"
+              << "  --sat               only say whether some row is true, and print the first.\n"
+              << "  --valid             only say whether every row is true, or print the first\n"
+              << "                      that is not.\n"
+              << "  --dnf               print a minimized sum of products with the same table.\n"
+              << "  --cnf               print a minimized product of sums with the same table.\n"
+              << "  --bits              print the results as a packed bitset, after a line with\n"
+              << "                      the number of rows and of bytes.\n"
+              << "  --bdd               say whether the expression is a tautology or a\n"
+              << "                      contradiction and how many rows are true, using a BDD\n"
+              << "                      instead of enumerating the rows.\n"
+              << "  --equiv FORMULA     same, also saying whether it is equivalent to FORMULA.\n"
+              << "  --gray              print the table in Gray code order, one proposition\n"
+              << "                      changes from row to row.\n"
+              << "  --columns WHICH     print only some columns: \"result\", \"all\" for every\n"
+              << "                      proposition and subexpression, or a comma separated\n"
+              << "                      list of propositions and subexpressions to show.\n"
+              << "  --split K           evaluate the rows for each assignment of the first K\n"
+              << "                      propositions through a formula specialized to it.\n"
+              << "  --jit               evaluate through machine code generated for the\n"
+              << "                      expression, where supported (x86-64 Unix).\n"
+              << "  --cache MB          remember up to MB megabytes of compiled formulas and\n"
+              << "                      result tables, so repeated expressions are looked up.\n"
+              << "  --shard K/N         only go through slice K (from 0) of N equal slices of\n"
+              << "                      the rows; binary files then hold that slice, see\n"
+              << "                      shard_merge for putting the slices together.\n"
+              << "  --threads N         evaluate rows on N threads (0 = one per core).\n"
+              << "  --chunk-size ROWS   rows given to a thread at a time (default 65536).\n"
+              << "  --max-memory MB     keep at most MB megabytes of output waiting to be\n"
+              << "                      written, by making chunks smaller.\n"
+              << "  --stats             when done, print the time spent in each phase and the\n"
+              << "                      rows, operations and output writes as JSON to stderr.\n"
+              << "  --serve PATH        answer requests, one expression per line, each may start\n"
+              << "                      with options like --count, on a Unix socket at PATH.\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::string batch_file = "-";
+    std::string serve_path;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--batch") {
+            options.batch = true;
+            if(i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) batch_file = argv[++i];
+        } else if(arg == "--binary" && i + 1 < argc) {
+            options.binary_file = argv[++i];
+        } else if(arg == "--count") {
+            options.mode = Options::COUNT;
+        } else if(arg == "--first") {
+            options.mode = Options::FIRST;
+        } else if(arg == "--only-true") {
+            options.mode = Options::TRUE_ROWS;
+        } else if(arg == "--only-false") {
+            options.mode = Options::FALSE_ROWS;
+        } else if(arg == "--sat") {
+            options.mode = Options::SAT;
+        } else if(arg == "--valid") {
+            options.mode = Options::VALID;
+        } else if(arg == "--dnf") {
+            options.mode = Options::DNF;
+        } else if(arg == "--cnf") {
+            options.mode = Options::CNF;
+        } else if(arg == "--bits") {
+            options.mode = Options::BITS;
+        } else if(arg == "--serve" && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if(arg == "--bdd") {
+            options.mode = Options::BDD;
+        } else if(arg == "--equiv" && i + 1 < argc) {
+            options.mode = Options::BDD;
+            options.equivalent_to = argv[++i];
+            Lexer lexer(options.equivalent_to);
+            Parser parser;
+            if(lexer.getTokens().empty() || !parser.parse(lexer.getTokens())) {
+                std::cerr << "Invalid formula for --equiv! " << (lexer.getTokens().empty() ? "It is empty" : parser.errorMessage()) << ".\n";
+                return 1;
+            }
+        } else if(arg == "--jit") {
+            options.jit = true;
+        } else if(arg == "--gray") {
+            options.gray = true;
+        } else if(arg == "--shard" && i + 1 < argc) {
+            char* end = nullptr;
+            options.shard_index = std::strtoull(argv[++i], &end, 10);
+            if(*end == '/') options.shard_count = std::strtoull(end + 1, &end, 10);
+            if(*end != '\0' || options.shard_count == 0 || options.shard_index >= options.shard_count ||
+               options.shard_count > 0xFFFFFFFF) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if(arg == "--columns" && i + 1 < argc) {
+            options.columns = argv[++i];
+        } else if(arg == "--stats") {
+            options.stats = std::make_shared<Stats>();
+        } else if((arg == "--threads" || arg == "--chunk-size" || arg == "--split" || arg == "--cache" ||
+                   arg == "--max-memory") && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long long value = std::strtoull(argv[++i], &end, 10);
+            if(*end != '\0') {
+                printUsage(argv[0]);
+                return 1;
+            }
+            if(arg == "--threads") {
+                options.thread_count = value ? static_cast<unsigned>(value) : std::max(1u, std::thread::hardware_concurrency());
+            } else if(arg == "--cache") {
+                options.cache = std::make_shared<FormulaCache>(static_cast<std::size_t>(std::min<unsigned long long>(value, SIZE_MAX >> 20)) << 20);
+            } else if(arg == "--max-memory") {
+                options.memory_limit = std::min<unsigned long long>(value, UINT64_MAX >> 20) << 20;
+            } else if(arg == "--split") {
+                options.split_count = static_cast<int>(std::min<unsigned long long>(value, CompiledFormula::MAX_VARIABLES));
+            } else {
+                options.chunk_rows = value;
             }
+        } else {
+            printUsage(argv[0]);
+            return 1;
         }
-        // Formatting.
-        std::cout << '\t' << std::setw((expression.size() + 1)/2) << TV[operands.top()] << std::endl;
-        operands.pop();
     }
-    std::cout << std::endl;
-} 
 
-int main() {
-    std::string answer = "";
-    
-    //Run loop, entering "quit" will stop the loop.
-    while(answer != "quit") {
-        evaluate(answer);
-        std::cout << "Enter proposition: ";
-        getline(std::cin, answer);
+    // Rows are written in large blocks, there is no need to keep std::cout in
+    // step with C stdio on every write.
+    std::ios::sync_with_stdio(false);
+
+    // With --stats everything going to std::cout is counted on its way.
+    std::unique_ptr<CountingBuffer> counting;
+    std::streambuf* original = std::cout.rdbuf();
+    if(options.stats) {
+        counting = std::make_unique<CountingBuffer>(original, *options.stats);
+        std::cout.rdbuf(counting.get());
+    }
+
+    int status = 0;
+    if(!serve_path.empty()) {
+        #ifdef TTG_POSIX
+            status = runServer(serve_path, options);
+        #else
+            std::cerr << "--serve needs Unix sockets, which this platform does not have.\n";
+            status = 1;
+        #endif
+    } else if(options.batch && batch_file == "-") {
+        runBatch(std::cin, options);
+    } else if(options.batch) {
+        std::ifstream file(batch_file);
+        if(file) {
+            runBatch(file, options);
+        } else {
+            std::cerr << "Cannot open " << batch_file << '\n';
+            status = 1;
+        }
+    } else {
+        std::string answer = "";
+        
+        //Run loop, entering "quit" will stop the loop.
+        while(answer != "quit") {
+            evaluate(answer, options, std::cout);
+            std::cout << "Enter proposition: ";
+            getline(std::cin, answer);
+        }
+    }
+
+    if(options.stats) {
+        std::cout.flush();
+        std::cout.rdbuf(original);
+        options.stats->print(std::cerr);
     }
-    return 0;
+    return status;
 }